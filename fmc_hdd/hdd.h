@@ -75,6 +75,8 @@
 #define HDD_NOTAIL_FL		0x00008000
 #define HDD_DIRSYNC_FL		0x00010000	/* dirsync behaviour (directories only) */
 #define HDD_TOPDIR_FL		0x00020000	/* Top of directory hierarchies*/
+#define HDD_EXTENTS_FL		0x00080000	/* ʹ extent ӳݿ */
+#define HDD_PENDING_FREE_FL	0x00100000	/* ɾ, ݿȴ̨ͷ */
 #define HDD_RESERVED_FL		0x80000000
 #define HDD_FL_USER_VISIBLE	0x0003DFFF	/* User visible flags */
 #define HDD_FL_USER_MODIFIABLE	0x00038FFF	/* User modifiable flags */
@@ -103,8 +105,21 @@
 #define	HDD_ADDR_PER_BLOCK	798		/* еַ */
 #define	HDD_ADDR_SIZE		3192		/* ַ */
 #define HDD_ADDR_BMAP_END	104		/* ַλͼյ, 100B Ч */
+#define HDD_ADDR_EPOCH		100		/* ֽڵļԪ __le16, λͼ֮ */
 #define HDD_ACCESS_END		904		/* ͳϢյ, 798B Ч */
+#define HDD_ADDR_START		(HDD_ACCESS_END / 4)	/* ׸ַ±: 226 */
 #define HDD_ADDR_END		4096		/* ַϢյ */
+#define HDD_ACCESS_UNWRITTEN	0xFF		/* ֽ: ѷ䵫δд */
+
+/* hdd_get_blocks  create  */
+#define HDD_GET_BLOCKS_CREATE	1		/* ʱ */
+#define HDD_GET_BLOCKS_PREALLOC	2		/* Ϊδд, תδд */
+#define HDD_GET_BLOCKS_NOWAIT	4		/* ֻ, ַ鲻ڴʱ -EAGAIN */
+#define HDD_GET_BLOCKS_DELALLOC	8		/* Ϊӳٿд, ԤĿ */
+#define HDD_GET_BLOCKS_NOACCT	16		/* ֻ, ʺͽж */
+
+/* пԤӴֵʱ, þȷļ */
+#define HDD_DA_WATERMARK	(4 * percpu_counter_batch * nr_cpu_ids)
 
 struct hdd_super_block {
 /*00*/	__le32		s_magic;		
@@ -146,15 +161,60 @@ struct hdd_super_block {
 	__le32		s_upper_ratio;		/* ǨƵĿռʹ */
 	__le32		s_max_unaccess;		/* ǨƵļ -  */
 	__le64		s_total_access;		/* ݿܷʴ */
-	__u32		s_pad1[78];		/* 䵽 512 ֽ */
+	__le32		s_pending_free_head;	/* ̨ͷŵ inode  */
+	__le32		s_heat_epoch;		/* ʼĵǰԪ */
+	__u32		s_pad1[76];		/* 䵽 512 ֽ */
 	__le32		s_blks_per_level[FMC_MAX_LEVELS];/* Լ1K-ÿʼĿ */
 	__le32		s_pad2[6];
 };
 
+/* Ԥ: ΪĳļڿԤ˽зΧ */
+#define HDD_DEFAULT_RESERVE_BLOCKS	8	/* ʼڿ */
+#define HDD_MAX_RESERVE_BLOCKS		1027	/* 󴰿ڿ */
+#define HDD_RESERVE_WINDOW_NOT_ALLOCATED 0	/* δ */
+
+/* ֲԤȶ: ѡĬֵ */
+#define HDD_RA_HDD_PAGES	128	/* HDD ϵĬԤ, ̯Ѱ */
+#define HDD_RA_SSD_PAGES	4	/* SSD ϵĬԤ, ٶ */
+#define HDD_ACCESS_INTERVAL	30	/* Ĭÿ 30 ѷдַ */
+#define HDD_HEAT_PERIOD		86400	/* Ĭÿʼ */
+#define HDD_HEAT_MIN_PERIOD	3600	/* Ԫ 16 λ, Ԫ 1 Сʱ */
+#define HDD_HEAT_MAX_SHIFT	8	/*  8 κκμΪ 0 */
+#define HDD_SKETCH_MAX_KB	65536	/* ȶ sketch  64M ڴ */
+#define HDD_SEQ_CUTOFF		256	/* Ĭ 1M ϵ˳ */
+#define HDD_PROMOTE_RATIO	50	/* Ĭȿ SSD п 50% */
+
+struct hdd_reserve_window_node {
+	struct rb_node	rsv_node;		/* ڳĴеĽڵ */
+	__u32		rsv_goal_size;		/* Ĵڿ */
+	__u32		rsv_alloc_hit;		/* ѷĿ */
+	unsigned int	rsv_start;		/* ׿ */
+	unsigned int	rsv_end;		/* ĩ */
+};
+
+struct hdd_block_alloc_info {
+	struct hdd_reserve_window_node rsv_window_node;
+	struct mutex	rsv_mutex;		/* Ԥ, ʱôڷ */
+	__u32		last_alloc_logical_block;/* ϴηһ߼ */
+	unsigned int	last_alloc_physical_block;/* ϴηһ */
+};
+
+/* Ŀ extent ,  fext.c */
+#define HDD_FEXT_NOINDEX	(-2)	/* , ɨλͼ */
+#define HDD_FEXT_ORDERS		16	/* ժҪļ, 2^15 Ϊλ */
+
+struct hdd_group_info {
+	struct mutex	gi_lock;		/*  */
+	struct rb_root	gi_root;		/* ʼλĿж */
+	struct rb_root	gi_len_root;		/* Ŀж */
+	unsigned int	gi_free;		/* еĿп */
+	int		gi_loaded;		/* Ƿλͼ */
+	int		gi_order;		/* ڿժҪеļ, -1 ʾ */
+};
+
 struct hdd_sb_info {
-	struct rw_semaphore	sbi_rwsem;	/* 䲿ʱ, Ӵ;
-						   ɱʱ,ȼӴ˶, ټӸ; 
-						   дʱ,д */
+	struct rw_semaphore	sbi_rwsem;	/* ֻлдж;
+						   ¼ʱӴ */
 
 	struct super_block	*sb;
 	struct buffer_head	*hdd_bh;
@@ -194,6 +254,8 @@ struct hdd_sb_info {
 	struct percpu_counter	total_access;	/* ݿܷʴ */
 	struct percpu_counter	*blks_per_lvl;	/* ÿʼеĿ */
 	struct percpu_counter	ssd_blks_count;	/* ǨƵ SSD Ŀ */
+	struct percpu_counter	dirty_blks_count;/* ӳٷԤĿ */
+	struct percpu_counter	pending_free_blks;/* ں̨ͷŵĿ */
 
 	struct mutex		ssd_mutex;	/* Ʒ ssd_info */	
 	struct ssd_sb_info	*ssd_info;	/* Ӧ ssd Ϣ */
@@ -207,6 +269,51 @@ struct hdd_sb_info {
 	
 	unsigned int		upper_ratio;	/* ǨƿĿռʹ */
 	unsigned int		max_unaccess;	/* Ǩļδ -  */
+
+	spinlock_t		s_rsv_window_lock;/* Ԥ */
+	struct rb_root		s_rsv_window_root;/* ʼԤ */
+	struct hdd_reserve_window_node s_rsv_window_head;/* еڱ */
+
+	struct hdd_group_info	*s_group_info;	/* ÿĿ extent  */
+	unsigned long		*s_group_summary;/* ժҪ: ÿһλͼ */
+	unsigned int		s_summary_longs;/* ÿλͼ long  */
+
+	/* ͷ inode : ô inode  i_dtime ¼һ inode  */
+	struct mutex		s_pending_lock;	/* ͷ */
+	unsigned int		s_pending_head;	/*  inode , 0 Ϊ */
+	struct task_struct	*s_reclaim_task;/* ̨ͷ߳ */
+
+	/* ֲԤ, ±Ϊλ BLOCK_ON_HDD / BLOCK_ON_SSD */
+	unsigned int		s_ra_pages[2];	/* Ԥҳ */
+	struct percpu_counter	s_ra_reads[2];	/* ò趨ڵĶ */
+	struct percpu_counter	s_ra_read_pages[2];/* Ԥҳ */
+	struct percpu_counter	s_ra_bios[2];	/* Ԥύ bio  */
+	struct proc_dir_entry	*s_proc;	/* /proc/fs/fmc_hdd/<豸> */
+
+	/* ʼ: ·ÿ CPU ,  access.c */
+	struct hdd_access_batch	*s_acc_batch;	/* ÿ CPU ķʼ¼ */
+	spinlock_t		s_acc_lock;	/*  s_acc_inodes */
+	struct list_head	s_acc_inodes;	/* δдķ inode */
+	atomic_t		s_acc_deltas;	/*  */
+	unsigned int		s_acc_interval;	/* д - , 0 Ϊֻͬʱ */
+	unsigned long		s_acc_next;	/* ´дʱ - jiffies */
+
+	/* ʼ𰴼Ԫ˥,  hdd_access.c */
+	struct rw_semaphore	s_heat_sem;	/* ƽԪд, ޸ blks_per_lvl ֶ */
+	unsigned int		s_heat_epoch;	/* ǰԪ */
+	unsigned int		s_heat_period;	/* Ԫ - , 0 Ϊ˥ */
+	unsigned long		s_heat_time;	/* ǰԪʼʱ -  */
+	struct hdd_sketch	*s_sketch;	/* ȶȹ, δΪ NULL */
+	unsigned int		s_sketch_kb;	/* sketch ڴ - KB, 0 Ϊ */
+
+	/*  SSD ׼,  promote.c */
+	unsigned int		s_promote_level;/* ȶȳ˼Ž */
+	unsigned int		s_sketch_level;	/*  sketch ʱ, ֵֵŽ */
+	unsigned int		s_promote_ratio;/* ȿõ SSD пٷֱ */
+	struct percpu_counter	s_promote_above;/* ڽĿ */
+	unsigned int		s_seq_cutoff;	/* ˳ﵽ˿, 0 Ϊ */
+	struct percpu_counter	s_promote_admit;/* ׼Ĳ */
+	struct percpu_counter	s_promote_seq;	/* ˳ܾĲ */
 };
 
 struct hdd_inode {
@@ -229,7 +336,7 @@ struct hdd_inode {
 	}s_cloud;
 	struct{
 	__le32		i_ssd_blocks;		/*  ssd еĿ */
-	__le16		i_pad;
+	__le16		i_heat_epoch;		/* ǰ12ʼļԪ */
 	__le16		i_direct_bits;		/* ǰ12λñ־ */
 	__u8		i_direct_blks[HDD_NDIR_BLOCKS];/* ǰ12ķʼ */
 	__le32		i_block[HDD_N_BLOCKS];	/* ַ[15] */
@@ -249,14 +356,59 @@ struct hdd_inode_info {
 	unsigned int	i_access_count;		/* ʼ */
 	unsigned int	i_ssd_blocks;		/*  SSD еĿ */
 	__u16		i_direct_bits;		/* ǰ12λñ־ */
-	__u16		i_pad;
+	__u16		i_heat_epoch;		/* ǰ12ʼļԪ */
 	__u8		i_direct_blks[HDD_NDIR_BLOCKS];	/* ǰ12ķʼ */
 					
-	struct mutex	truncate_mutex;		/* л hdd_truncate, hdd_getblock */
-	rwlock_t	i_meta_lock;
+	struct mutex	truncate_mutex;		/* лض */
+	spinlock_t	i_range_lock;		/*  i_ranges */
+	struct list_head i_ranges;		/* Ѽ߼鷶Χ,  hdd_range_lock */
+	wait_queue_head_t i_range_wait;		/* ȴΧĽ */
+	seqlock_t	i_meta_seq;		/* ޸ĵַʱд, ֤ */
+	struct rw_semaphore i_data_sem;		/*  extent  */
+	struct hdd_block_alloc_info *i_block_alloc_info;/* Ԥ, ״ηʱ */
+	unsigned int	i_reserved_data_blocks;	/* ӳٷԤĿ, i_lock  */
+	spinlock_t	i_map_lock;		/* ӳ仺 */
+	struct list_head i_map_list;		/* ӳ仺,  mcache.c */
+	struct list_head i_map_lru;		/* ȫֵл inode  */
+	unsigned int	i_map_count;		/*  */
+	unsigned int	i_map_gen;		/* ӳʧЧ */
+	struct list_head i_acc_list;		/* δдķ, i_map_lock  */
+	struct list_head i_acc_inodes;		/*  s_acc_inodes  */
+	unsigned long	i_seq_next;		/* ˳һ */
+	unsigned int	i_seq_len;		/* ˳Ŀ */
 	struct list_head i_orphan;		/* unlinked but open inodes */
 };
 
+/* extent : ڵ i_data , ڵռһ */
+#define HDD_EXT_MAGIC		0xF3EA		/* extent ڵħ */
+#define HDD_EXT_MAX_DEPTH	4		/*  */
+#define HDD_EXT_MAX_LEN		0xFFFF		/* һ extent  */
+#define HDD_EXT_MAX_BLOCK	0xFFFFFFFF	/* ߼ */
+
+#define HDD_EXT_ON_SSD		0x0001		/* extent  SSD  */
+#define HDD_EXT_UNWRITTEN	0x0002		/* ѷδд, Ϊ */
+
+struct hdd_extent_header {			/* ڵͷ - 12 Bytes */
+	__le16		eh_magic;		/* ħ */
+	__le16		eh_entries;		/* Ч */
+	__le16		eh_max;			/*  */
+	__le16		eh_depth;		/* ڵ߶, 0 ΪҶڵ */
+	__le32		eh_pad;
+};
+
+struct hdd_extent {				/* Ҷڵ - 12 Bytes */
+	__le32		ee_block;		/* ׸߼ */
+	__le32		ee_start;		/* ׸ */
+	__le16		ee_len;			/*  */
+	__le16		ee_flags;		/* 豸ȱ־ */
+};
+
+struct hdd_extent_idx {				/* ڵ - 12 Bytes */
+	__le32		ei_block;		/* е׸߼ */
+	__le32		ei_leaf;		/* ӽڵڿ */
+	__le32		ei_pad;
+};
+
 struct hdd_group_desc {
 	__le32		bg_block_bitmap;	/* λͼĿ */
 	__le32		bg_inode_bitmap;	/* inode λͼĿ */
@@ -289,11 +441,56 @@ static inline struct hdd_sb_info *HDD_SB(struct super_block *sb)
 	return (struct hdd_sb_info *) sb->s_fs_info;
 }
 
+/* ǳ˽ϢΪ; ʱд,  CPU ͬһ */
+static inline void hdd_mark_sb_dirty(struct super_block *sb)
+{
+	struct hdd_sb_info *sbi = HDD_SB(sb);
+
+	/*  hdd_do_sync_fs е smp_mb : ɼĸٶ,
+	   ܶǰľɱ, дѶɵļ */
+	smp_mb();
+	if (!sbi->s_dirty || !sb->s_dirt)
+		sb->s_dirt = sbi->s_dirty = 1;
+}
+
+/* ķʼ old Ϊ new, ڽĿ;
+ * ߳ s_heat_sem , 𲻻ı */
+static inline void hdd_promote_move(struct hdd_sb_info *sbi,
+	unsigned int old, unsigned int new)
+{
+	unsigned int lvl = sbi->s_promote_level;
+
+	if ((old > lvl) != (new > lvl))
+		percpu_counter_add(&sbi->s_promote_above, new > lvl ? 1 : -1);
+}
+
 static inline struct hdd_inode_info *HDD_I(struct inode *inode)
 {
 	return container_of(inode, struct hdd_inode_info, vfs_inode);
 }
 
+/* hdd_map_blocks صӳ־ */
+#define HDD_MAP_NEW		0x01		/* · */
+#define HDD_MAP_MAPPED		0x02		/* ӳ, Ϊնδд */
+#define HDD_MAP_BOUNDARY	0x04		/* β֮ǵַ */
+
+/* һݿ,  access.c */
+struct hdd_access_rec {
+	struct inode		*inode;
+	unsigned int		gen;		/* ¼ʱ i_map_gen, ֮ʧЧ */
+	unsigned int		ablk;		/* һַ, ֱӿΪ 0 */
+	unsigned int		aidx;		/* ַڿе±, ֱӿ */
+};
+
+/* һ߼鵽һ豸ӳ */
+struct hdd_map_blocks {
+	sector_t		m_lblk;		/* ߼ʼ */
+	unsigned int		m_len;		/* , ʱΪӳĿ */
+	sector_t		m_pblk;		/* ʼ */
+	struct block_device	*m_bdev;	/* 豸: HDD  SSD */
+	unsigned int		m_flags;	/* HDD_MAP_* */
+};
+
 /* inode ڴʹϵλ */
 struct hdd_iloc {
 	struct buffer_head *bh;
@@ -320,6 +517,26 @@ hdd_group_first_block_no(struct super_block *sb, unsigned long group_no)
 		le32_to_cpu(HDD_SB(sb)->hdd_sb->s_first_data_block);
 }
 
+/* ׸ݿĿ, λͼе 0 λӦĿ */
+static inline unsigned int
+hdd_group_data_first_block(struct super_block *sb, unsigned long group_no)
+{
+	return hdd_group_first_block_no(sb, group_no) +
+		HDD_SB(sb)->grp_data_offset;
+}
+
+/* еݿ, λͼеЧλ */
+static inline unsigned int
+hdd_group_data_blocks(struct super_block *sb, unsigned long group_no)
+{
+	struct hdd_sb_info *sbi = HDD_SB(sb);
+	unsigned int blocks = sbi->blks_per_group;
+
+	if (group_no == sbi->groups_count - 1)
+		blocks = sbi->last_group_blks;
+	return blocks - sbi->grp_data_offset;
+}
+
 /*  ino ǷϷ */
 static inline int hdd_valid_inum(struct super_block *sb, unsigned long ino)
 {
@@ -331,11 +548,14 @@ static inline int hdd_valid_inum(struct super_block *sb, unsigned long ino)
 /* ѡ */
 #define HDD_MOUNT_CHECK			0x00001	/* װʱ */
 #define HDD_MOUNT_DEBUG			0x00008	/* һЩϢ */
+#define HDD_MOUNT_EXTENTS		0x00010	/* ³ļʹ extent  */
+#define HDD_MOUNT_RESERVATION		0x00020	/* ʹÿԤ */
+#define HDD_MOUNT_DELALLOC		0x00040	/* ļӳٷ */
 
 /* , , Թѡ */
 #define clear_opt(o, opt)		o &= ~HDD_MOUNT_##opt
 #define set_opt(o, opt)			o |= HDD_MOUNT_##opt
-#define test_opt(sb, opt)		(HDD_SB(sb)->s_mount_opt & \
+#define test_opt(sb, opt)		(HDD_SB(sb)->mount_opt & \
 					HDD_MOUNT_##opt)
 
 /* ϣĿ¼ */
@@ -375,7 +595,7 @@ extern unsigned long hdd_bg_num_gdb(struct super_block *sb, int group);
 extern unsigned int hdd_new_block (struct inode *inode, unsigned int goal,
 				 int *errp);
 extern unsigned int hdd_new_blocks (struct inode *inode, unsigned int goal, 
-				   unsigned long *count, int *errp);
+				   unsigned long *count, int delalloc, int *errp);
 extern void hdd_free_blocks (struct inode *inode, unsigned int block, 
 			     unsigned long count);
 extern void hdd_free_blocks_sb (struct super_block *sb, unsigned int block, 
@@ -386,6 +606,96 @@ extern struct hdd_group_desc * hdd_get_group_desc(struct super_block * sb,
 				unsigned int block_group, struct buffer_head ** bh);
 extern int hdd_should_retry_alloc(struct super_block *sb, int *retries);
 extern void hdd_init_block_alloc_info(struct inode *);
+extern void hdd_discard_reservation (struct inode *);
+extern void hdd_rsv_window_add(struct super_block *sb,
+			       struct hdd_reserve_window_node *rsv);
+
+/* extent ӳ - extents.c */
+extern void hdd_ext_tree_init(struct inode *inode);
+extern int hdd_ext_check_inode(struct inode *inode);
+extern int hdd_ext_get_blocks(struct inode *inode, sector_t iblock,
+			unsigned long maxblocks, struct buffer_head *bh_result,
+			int create);
+extern int hdd_ext_remove_space(struct inode *inode, unsigned int start,
+			unsigned int end);
+extern void hdd_ext_truncate(struct inode *inode);
+extern unsigned int hdd_ext_alloc_end(struct inode *inode);
+
+/*  extent  - fext.c */
+extern int hdd_fext_init(struct super_block *sb);
+extern void hdd_fext_destroy(struct hdd_sb_info *sbi);
+extern int hdd_fext_alloc(struct super_block *sb, unsigned int group,
+			struct buffer_head *bitmap_bh, int grp_goal, int start,
+			int end, unsigned long *count, int best_fit);
+extern int hdd_fext_next_free(struct super_block *sb, unsigned int group,
+			unsigned int bit);
+extern void hdd_fext_free(struct super_block *sb, unsigned int group,
+			unsigned int bit, unsigned int count);
+extern void hdd_fext_update(struct super_block *sb, unsigned int group);
+extern int hdd_fext_next_group(struct super_block *sb, unsigned int start,
+			unsigned int need);
+extern int hdd_init_fext_cache(void);
+extern void hdd_destroy_fext_cache(void);
+
+/* inode ӳ仺 - mcache.c */
+extern unsigned int hdd_map_cache_gen(struct inode *inode);
+extern int hdd_map_cache_lookup(struct inode *inode, unsigned long lblk,
+			unsigned int *pblk, unsigned int *len, int *loc,
+			int *boundary, struct hdd_access_rec *rec);
+extern void hdd_map_cache_insert(struct inode *inode, unsigned long lblk,
+			unsigned int pblk, unsigned int len, int loc,
+			int boundary, unsigned int ablk, unsigned int aidx,
+			unsigned int gen);
+extern void hdd_map_cache_invalidate(struct inode *inode,
+			unsigned long start, unsigned long end);
+extern void hdd_map_cache_drop(struct inode *inode);
+extern int hdd_init_map_cache(void);
+extern void hdd_destroy_map_cache(void);
+
+/* ʼ - access.c */
+extern void hdd_access_note(struct inode *inode, struct hdd_access_rec *rec);
+extern void hdd_access_clear(struct inode *inode);
+extern void hdd_access_forget(struct inode *inode);
+extern void hdd_access_fold(struct super_block *sb);
+extern int hdd_access_init(struct hdd_sb_info *sbi);
+extern void hdd_access_destroy(struct hdd_sb_info *sbi);
+extern void access_info_fold(struct inode *inode, unsigned int ablk,
+			const __u8 *delta);
+extern int access_info_age(struct inode *inode, struct buffer_head *bh);
+
+/* ȶ sketch - sketch.c */
+extern unsigned int hdd_sketch_add(struct inode *inode, sector_t lblk);
+extern void hdd_sketch_age(struct hdd_sb_info *sbi);
+extern void hdd_sketch_update_level(struct hdd_sb_info *sbi, s64 budget);
+extern int hdd_sketch_init(struct hdd_sb_info *sbi, unsigned int kbytes);
+extern void hdd_sketch_destroy(struct hdd_sb_info *sbi);
+
+/* ׼ - promote.c */
+extern int hdd_promote_admit(struct inode *inode, sector_t iblock,
+			unsigned int count, int location, unsigned int heat);
+extern void hdd_promote_update(struct super_block *sb);
+extern void hdd_promote_reset(struct hdd_sb_info *sbi);
+extern int hdd_promote_proc_register(struct super_block *sb);
+extern void hdd_promote_proc_unregister(struct super_block *sb);
+
+/* 豸Ķҳд, ֲԤ - mpage.c */
+extern int hdd_mpage_readpages(struct address_space *mapping,
+			struct list_head *pages, unsigned nr_pages);
+extern int hdd_mpage_writepages(struct address_space *mapping,
+			struct writeback_control *wbc, get_block_t get_block);
+extern void hdd_ra_prepare(struct file *filp, loff_t pos, size_t count);
+extern int hdd_ra_proc_register(struct super_block *sb);
+extern void hdd_ra_proc_unregister(struct super_block *sb);
+extern int hdd_init_ra_proc(void);
+extern void hdd_destroy_ra_proc(void);
+
+/* ֱֲ I/O - dio.c */
+extern ssize_t hdd_dio_tiered(int rw, struct kiocb *iocb,
+			const struct iovec *iov, loff_t offset,
+			unsigned long nr_segs);
+extern int hdd_dio_on_ssd(struct inode *inode, loff_t offset, size_t size);
+extern int hdd_dio_get_block(struct inode *inode, sector_t iblock,
+			struct buffer_head *bh_result, int create);
 
 /* dir.c */
 extern int hdd_check_dir_entry(const char *, struct inode *,
@@ -416,21 +726,31 @@ struct buffer_head * hdd_bread (struct inode *, int, int, int *);
 int hdd_get_blocks_handle(struct inode *inode,
 			  sector_t iblock, unsigned long maxblocks,
 			  struct buffer_head *bh_result, int create);
+extern int hdd_get_block(struct inode *inode, sector_t iblock,
+			 struct buffer_head *bh_result, int create);
+extern int hdd_map_blocks(struct inode *inode, struct hdd_map_blocks *map,
+			  int create);
 extern struct inode *hdd_iget(struct super_block *, unsigned long);
 extern int  hdd_write_inode (struct inode *, int);
 extern void hdd_delete_inode (struct inode *);
 extern int  hdd_sync_inode (struct inode *);
-extern void hdd_discard_reservation (struct inode *);
 extern void hdd_dirty_inode(struct inode *);
 extern int  hdd_change_inode_journal_flag(struct inode *, int);
 extern int  hdd_get_inode_loc(struct inode *, struct hdd_iloc *);
 extern int  hdd_can_truncate(struct inode *inode);
+extern void hdd_ssd_release_blocks(struct inode *inode, unsigned int block,
+				   unsigned long count);
+extern void hdd_da_release_space(struct inode *inode, int to_free);
+extern int  hdd_start_reclaim(struct super_block *sb);
+extern void hdd_stop_reclaim(struct super_block *sb);
 extern void hdd_truncate (struct inode *);
 extern void hdd_set_inode_flags(struct inode *);
 extern void hdd_get_inode_flags(struct hdd_inode_info *);
 extern void hdd_set_aops(struct inode *inode);
 extern int  hdd_fiemap(struct inode *inode, struct fiemap_extent_info *fieinfo,
 		       u64 start, u64 len);
+extern long hdd_fallocate(struct inode *inode, int mode, loff_t offset,
+			  loff_t len);
 extern int hdd_setattr(struct dentry *dentry, struct iattr *iattr);
 
 /*  - ioctl.c */
@@ -474,6 +794,7 @@ extern void hdd_set_link(struct inode *dir, struct hdd_dir_entry *de,
 	} while (0)
 
 extern const struct address_space_operations hdd_aops;
+extern const struct address_space_operations hdd_da_aops;
 /* Ŀ¼ļ  - dir.c */
 extern const struct file_operations hdd_dir_operations;
 /* ļ - file.c */
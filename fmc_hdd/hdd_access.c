@@ -0,0 +1,308 @@
+/*
+ * fmcfs/fmc_hdd/hdd_access.c
+ *
+ * Copyright (C) 2013 by Xuesen Liang, <liangxuesen@gmail.com>
+ * @ Beijing University of Posts and Telecommunications,
+ * @ CPU & SoC Center of Tsinghua University.
+ *
+ * This program can be redistributed under the terms of the GNU Public License.
+ */
+
+/*
+ * ݿķʼ.
+ *
+ * ʼһַķֽ(ֱӿ inode ), ÿζ
+ * ޸ HDD ϵĵַŪ. ˶·ֻһηʼ뱾 CPU 
+ * ; ʱ inode ķ(ÿַһ,  i_map_lock ).
+ * ̨߳ÿ s_acc_interval , Լͬļϵͳʱ, һд
+ * ַ inode.
+ *
+ * ض, 򶴺Ǩƻͷŵַ, ǵ hdd_map_cache_invalidate 
+ * i_map_gen  inode ȫ; дŹʱļ¼ڲʱ,
+ * дͷŵĿ.
+ *
+ * ʼ𰴼Ԫ˥: ÿ s_heat_period һԪ, . ƽ
+ * Ԫʱֻ blks_per_lvl 尴, ɨ; ÿַ(ֱӿ
+ * inode )¼ֽڵļԪ, дɨʱŰļԪ
+ * ˥,  blks_per_lvl ļһ,  blks_per_lvl ʼշӳǰ
+ * Ԫļ, ֻڼıʱ.
+ */
+
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/rwsem.h>
+#include <linux/percpu.h>
+#include <linux/buffer_head.h>
+
+#include "hdd.h"
+
+#define HDD_ACCESS_BATCH	32	/* ÿ CPU еļ¼ */
+#define HDD_ACCESS_MAX_DELTAS	4096	/* ÿļϵͳ */
+
+/* ÿ CPU ķʼ¼ */
+struct hdd_access_batch {
+	spinlock_t		lock;
+	unsigned int		nr;
+	struct hdd_access_rec	recs[HDD_ACCESS_BATCH];
+};
+
+/* һַ( inode ֱӿ)иķ */
+struct hdd_access_delta {
+	struct list_head	ad_list;	/*  i_acc_list */
+	unsigned int		ad_blk;		/* һַ, 0 Ϊֱӿ */
+	__u8			ad_delta[HDD_ADDR_PER_BLOCK];
+};
+
+/* ַ aidx е± */
+static inline unsigned int delta_index(unsigned int ablk, unsigned int aidx)
+{
+	return ablk ? aidx - HDD_ADDR_START : aidx;
+}
+
+/* ͷ inode ȫ, ߳ i_map_lock */
+void hdd_access_clear(struct inode *inode)
+{
+	struct hdd_sb_info *sbi = HDD_SB(inode->i_sb);
+	struct hdd_inode_info *hi = HDD_I(inode);
+	struct hdd_access_delta *ad, *tmp;
+
+	list_for_each_entry_safe(ad, tmp, &hi->i_acc_list, ad_list) {
+		list_del(&ad->ad_list);
+		kfree(ad);
+		atomic_dec(&sbi->s_acc_deltas);
+	}
+	if (!list_empty(&hi->i_acc_inodes)) {
+		spin_lock(&sbi->s_acc_lock);
+		list_del_init(&hi->i_acc_inodes);
+		spin_unlock(&sbi->s_acc_lock);
+	}
+}
+
+/* һ¼ inode , ߳ */
+static void access_merge(struct hdd_sb_info *sbi, struct hdd_access_rec *rec)
+{
+	struct hdd_inode_info *hi = HDD_I(rec->inode);
+	struct hdd_access_delta *ad;
+	__u8 *delta;
+
+	spin_lock(&hi->i_map_lock);
+	if (rec->gen != hi->i_map_gen)	/* ضϹ, ַͷ */
+		goto out;
+
+	list_for_each_entry(ad, &hi->i_acc_list, ad_list)
+		if (ad->ad_blk == rec->ablk)
+			goto found;
+
+	if (atomic_read(&sbi->s_acc_deltas) >= HDD_ACCESS_MAX_DELTAS) {
+		sbi->s_acc_next = jiffies;	/* , Ѻ̨߳̾첢 */
+		if (sbi->s_reclaim_task)
+			wake_up_process(sbi->s_reclaim_task);
+		goto out;
+	}
+	ad = kzalloc(sizeof(*ad), GFP_ATOMIC);
+	if (!ad)
+		goto out;
+	ad->ad_blk = rec->ablk;
+	list_add(&ad->ad_list, &hi->i_acc_list);
+	atomic_inc(&sbi->s_acc_deltas);
+
+	if (list_empty(&hi->i_acc_inodes)) {
+		spin_lock(&sbi->s_acc_lock);
+		list_add_tail(&hi->i_acc_inodes, &sbi->s_acc_inodes);
+		spin_unlock(&sbi->s_acc_lock);
+	}
+found:
+	delta = &ad->ad_delta[delta_index(rec->ablk, rec->aidx)];
+	if (*delta < FMC_MAX_LEVELS - 1)
+		(*delta)++;
+out:
+	spin_unlock(&hi->i_map_lock);
+}
+
+/* һем¼, ߳ */
+static void access_drain(struct hdd_sb_info *sbi, struct hdd_access_batch *b)
+{
+	unsigned int i;
+
+	for (i = 0; i < b->nr; i++)
+		if (b->recs[i].inode)
+			access_merge(sbi, &b->recs[i]);
+	b->nr = 0;
+}
+
+/* ¼һη, ޸ĵַ */
+void hdd_access_note(struct inode *inode, struct hdd_access_rec *rec)
+{
+	struct hdd_sb_info *sbi = HDD_SB(inode->i_sb);
+	struct hdd_access_batch *b;
+
+	if (!sbi->s_acc_batch || (inode->i_sb->s_flags & MS_RDONLY))
+		return;
+
+	b = per_cpu_ptr(sbi->s_acc_batch, get_cpu());
+	spin_lock(&b->lock);
+	b->recs[b->nr] = *rec;
+	b->recs[b->nr].inode = inode;
+	if (++b->nr == HDD_ACCESS_BATCH)
+		access_drain(sbi, b);
+	spin_unlock(&b->lock);
+	put_cpu();
+}
+
+/* ͷ inode ʱ: ȥָļ¼,  */
+void hdd_access_forget(struct inode *inode)
+{
+	struct hdd_sb_info *sbi = HDD_SB(inode->i_sb);
+	struct hdd_inode_info *hi = HDD_I(inode);
+	struct hdd_access_batch *b;
+	unsigned int i;
+	int cpu;
+
+	if (!sbi->s_acc_batch)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		b = per_cpu_ptr(sbi->s_acc_batch, cpu);
+		spin_lock(&b->lock);
+		for (i = 0; i < b->nr; i++)
+			if (b->recs[i].inode == inode)
+				b->recs[i].inode = NULL;
+		spin_unlock(&b->lock);
+	}
+
+	spin_lock(&hi->i_map_lock);
+	hdd_access_clear(inode);
+	spin_unlock(&hi->i_map_lock);
+}
+
+/* һ inode дַ inode, ߳ inode  */
+static void access_fold_inode(struct inode *inode)
+{
+	struct hdd_inode_info *hi = HDD_I(inode);
+	struct hdd_access_delta *ad, *tmp;
+	LIST_HEAD(list);
+
+	/*  truncate_mutex ʱַ鲻ᱻͷ */
+	mutex_lock(&hi->truncate_mutex);
+	spin_lock(&hi->i_map_lock);
+	list_splice_init(&hi->i_acc_list, &list);
+	spin_unlock(&hi->i_map_lock);
+
+	list_for_each_entry_safe(ad, tmp, &list, ad_list) {
+		access_info_fold(inode, ad->ad_blk, ad->ad_delta);
+		list_del(&ad->ad_list);
+		kfree(ad);
+		atomic_dec(&HDD_SB(inode->i_sb)->s_acc_deltas);
+	}
+	mutex_unlock(&hi->truncate_mutex);
+}
+
+/* ʱƽԪ,  blks_per_lvl еĸ */
+static void hdd_heat_advance(struct super_block *sb)
+{
+	struct hdd_sb_info *sbi = HDD_SB(sb);
+	unsigned long now = get_seconds();
+	unsigned int n, i, lvl;
+	s64 count;
+
+	if (!sbi->s_heat_period || now - sbi->s_heat_time < sbi->s_heat_period)
+		return;
+	n = (now - sbi->s_heat_time) / sbi->s_heat_period;
+
+	down_write(&sbi->s_heat_sem);
+	for (i = 0; i < min_t(unsigned int, n, HDD_HEAT_MAX_SHIFT); i++) {
+		/*  lvl  lvl/2, Ѵ;  0  */
+		for (lvl = 1; lvl < FMC_MAX_LEVELS; lvl++) {
+			count = percpu_counter_sum(&sbi->blks_per_lvl[lvl]);
+			if (!count)
+				continue;
+			percpu_counter_set(&sbi->blks_per_lvl[lvl], 0);
+			if (lvl >> 1)
+				percpu_counter_add(&sbi->blks_per_lvl[lvl >> 1],
+						   count);
+		}
+	}
+	sbi->s_heat_epoch += n;
+	sbi->s_heat_time += (unsigned long) n * sbi->s_heat_period;
+	hdd_promote_reset(sbi);		/* ֲı */
+	up_write(&sbi->s_heat_sem);
+
+	hdd_mark_sb_dirty(sb);
+}
+
+/* δķдַ, ɺ̶̨߳ڵ, ͬʱҲ */
+void hdd_access_fold(struct super_block *sb)
+{
+	struct hdd_sb_info *sbi = HDD_SB(sb);
+	struct hdd_access_batch *b;
+	struct hdd_inode_info *hi;
+	struct inode *inode;
+	LIST_HEAD(list);
+	int cpu;
+
+	if (!sbi->s_acc_batch)
+		return;
+
+	hdd_heat_advance(sb);
+
+	for_each_possible_cpu(cpu) {
+		b = per_cpu_ptr(sbi->s_acc_batch, cpu);
+		spin_lock(&b->lock);
+		access_drain(sbi, b);
+		spin_unlock(&b->lock);
+	}
+
+	/* ֻ˿ inode, ¼´ */
+	spin_lock(&sbi->s_acc_lock);
+	list_splice_init(&sbi->s_acc_inodes, &list);
+	spin_unlock(&sbi->s_acc_lock);
+
+	for (;;) {
+		spin_lock(&sbi->s_acc_lock);
+		if (list_empty(&list)) {
+			spin_unlock(&sbi->s_acc_lock);
+			break;
+		}
+		hi = list_entry(list.next, struct hdd_inode_info, i_acc_inodes);
+		list_del_init(&hi->i_acc_inodes);
+		inode = igrab(&hi->vfs_inode);	/* ͷŵ forget  */
+		spin_unlock(&sbi->s_acc_lock);
+
+		if (!inode)
+			continue;
+		access_fold_inode(inode);
+		iput(inode);
+		cond_resched();
+	}
+
+	hdd_promote_update(sb);		/* ֲѱ */
+}
+
+/* ÿ CPU , ʱ */
+int hdd_access_init(struct hdd_sb_info *sbi)
+{
+	int cpu;
+
+	spin_lock_init(&sbi->s_acc_lock);
+	INIT_LIST_HEAD(&sbi->s_acc_inodes);
+	atomic_set(&sbi->s_acc_deltas, 0);
+	init_rwsem(&sbi->s_heat_sem);
+	sbi->s_heat_epoch = le32_to_cpu(sbi->hdd_sb->s_heat_epoch);
+	sbi->s_heat_time = get_seconds();	/* δصʱ䲻 */
+
+	sbi->s_acc_batch = alloc_percpu(struct hdd_access_batch);
+	if (!sbi->s_acc_batch)
+		return -ENOMEM;
+	for_each_possible_cpu(cpu) {
+		spin_lock_init(&per_cpu_ptr(sbi->s_acc_batch, cpu)->lock);
+		per_cpu_ptr(sbi->s_acc_batch, cpu)->nr = 0;
+	}
+	return 0;
+}
+
+/* ͷÿ CPU , ʱ inode ȫͷ */
+void hdd_access_destroy(struct hdd_sb_info *sbi)
+{
+	free_percpu(sbi->s_acc_batch);
+	sbi->s_acc_batch = NULL;
+}
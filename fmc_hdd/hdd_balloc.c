@@ -11,6 +11,7 @@
 #include <linux/sched.h>
 #include <linux/buffer_head.h>
 #include <linux/capability.h>
+#include <linux/slab.h>
 
 #include "hdd.h"
 
@@ -55,19 +56,16 @@ static void group_adjust_blocks(struct super_block *sb, int group_no,
 		struct hdd_sb_info *sbi = HDD_SB(sb);
 		unsigned free_blocks;
 
-		down_read(&sbi->sbi_rwsem);
-
 		spin_lock(sb_bgl_lock(sbi, group_no)); /* п */
 		free_blocks = le32_to_cpu(desc->bg_free_blocks_count);
 		desc->bg_free_blocks_count = cpu_to_le32(free_blocks + count);
 		spin_unlock(sb_bgl_lock(sbi, group_no));
 
 		percpu_counter_add(&sbi->free_blks_count, count);/* ܿп */
+		hdd_fext_update(sb, group_no);	/* ժҪ */
 
-		sb->s_dirt = sbi->s_dirty = 1;
+		hdd_mark_sb_dirty(sb);
 		mark_buffer_dirty(bh);
-
-		up_read(&sbi->sbi_rwsem);
 	}
 }
 
@@ -130,6 +128,9 @@ void hdd_free_blocks (struct inode * inode,
 		}
 	}
 
+	/* λ extent  */
+	hdd_fext_free(sb, block_group, bit, count);
+
 	mark_buffer_dirty(bitmap_bh);	/* λͼ޸ */
 	if (sb->s_flags & MS_SYNCHRONOUS)
 		sync_dirty_buffer(bitmap_bh);
@@ -146,15 +147,22 @@ error_return:
 	}
 }
 
-/* ļϵͳǷпп */
-static int hdd_has_free_blocks(struct hdd_sb_info *sbi)
+/* ɷĿп; ӳٷԤĿֻдʱΪӳٿ */
+static s64 hdd_has_free_blocks(struct hdd_sb_info *sbi, int delalloc)
 {
-	unsigned int free_blocks = 
-		percpu_counter_read_positive(&sbi->free_blks_count);
+	s64 free_blocks, dirty_blocks;
 
-	if (free_blocks < 1 ) 
-			return 0;
-	return 1;
+	free_blocks = percpu_counter_read_positive(&sbi->free_blks_count);
+	if (delalloc)
+		return free_blocks;
+
+	dirty_blocks = percpu_counter_read_positive(&sbi->dirty_blks_count);
+	if (free_blocks < dirty_blocks + HDD_DA_WATERMARK) {
+		/* ӽʱʹþȷֵ */
+		free_blocks = percpu_counter_sum_positive(&sbi->free_blks_count);
+		dirty_blocks = percpu_counter_sum_positive(&sbi->dirty_blks_count);
+	}
+	return free_blocks > dirty_blocks ? free_blocks - dirty_blocks : 0;
 }
 
 /* ȡĿλͼ */
@@ -242,27 +250,341 @@ static int find_next_usable_block(int start,
 	return here;
 }
 
+/* ԤвҰ goal Ĵ, û, 򷵻 goal ֮ǰĴ */
+static struct hdd_reserve_window_node *
+search_reserve_window(struct rb_root *root, unsigned int goal)
+{
+	struct rb_node *n = root->rb_node;
+	struct hdd_reserve_window_node *rsv;
+
+	if (!n)
+		return NULL;
+
+	do {
+		rsv = rb_entry(n, struct hdd_reserve_window_node, rsv_node);
+
+		if (goal < rsv->rsv_start)
+			n = n->rb_left;
+		else if (goal > rsv->rsv_end)
+			n = n->rb_right;
+		else
+			return rsv;
+	} while (n);
+
+	/* ͣ goal ֮Ĵ, ˻ǰһ; ڱڱ֤ */
+	if (rsv->rsv_start > goal) {
+		n = rb_prev(&rsv->rsv_node);
+		rsv = rb_entry(n, struct hdd_reserve_window_node, rsv_node);
+	}
+	return rsv;
+}
+
+/* Ѵڲ볬Ĵ, ߳ s_rsv_window_lock */
+void hdd_rsv_window_add(struct super_block *sb,
+	struct hdd_reserve_window_node *rsv)
+{
+	struct rb_root *root = &HDD_SB(sb)->s_rsv_window_root;
+	struct rb_node *node = &rsv->rsv_node;
+	unsigned int start = rsv->rsv_start;
+	struct rb_node **p = &root->rb_node;
+	struct rb_node *parent = NULL;
+	struct hdd_reserve_window_node *this;
+
+	while (*p) {
+		parent = *p;
+		this = rb_entry(parent, struct hdd_reserve_window_node,
+				rsv_node);
+
+		if (start < this->rsv_start)
+			p = &(*p)->rb_left;
+		else if (start > this->rsv_end)
+			p = &(*p)->rb_right;
+		else {
+			hdd_msg(sb, KERN_ERR, __func__,
+				"overlapping reservation window %u-%u",
+				this->rsv_start, this->rsv_end);
+			BUG();
+		}
+	}
+
+	rb_link_node(node, parent, p);
+	rb_insert_color(node, root);
+}
+
+/* ѴڴӴȡ, ߳ s_rsv_window_lock */
+static void rsv_window_remove(struct super_block *sb,
+	struct hdd_reserve_window_node *rsv)
+{
+	rsv->rsv_start = HDD_RESERVE_WINDOW_NOT_ALLOCATED;
+	rsv->rsv_end = HDD_RESERVE_WINDOW_NOT_ALLOCATED;
+	rsv->rsv_alloc_hit = 0;
+	rb_erase(&rsv->rsv_node, &HDD_SB(sb)->s_rsv_window_root);
+}
+
+/* Ƿδ */
+static inline int rsv_is_empty(struct hdd_reserve_window_node *rsv)
+{
+	return rsv->rsv_end == HDD_RESERVE_WINDOW_NOT_ALLOCATED;
+}
+
+/* 鴰Ƿλڿ group , Ŀλ grp_goal */
+static int goal_in_my_reservation(struct hdd_reserve_window_node *rsv,
+	int grp_goal, unsigned int group, struct super_block *sb)
+{
+	unsigned int group_first_block, group_last_block;
+
+	group_first_block = hdd_group_data_first_block(sb, group);
+	group_last_block = group_first_block +
+		hdd_group_data_blocks(sb, group) - 1;
+
+	if (rsv->rsv_start > group_last_block ||
+	    rsv->rsv_end < group_first_block)
+		return 0;
+	if (grp_goal >= 0 && (grp_goal + group_first_block < rsv->rsv_start ||
+	    grp_goal + group_first_block > rsv->rsv_end))
+		return 0;
+	return 1;
+}
+
+/* ʼ inode ĿԤϢ, ߳ truncate_mutex( i_data_sem) */
+void hdd_init_block_alloc_info(struct inode *inode)
+{
+	struct hdd_inode_info *hi = HDD_I(inode);
+	struct hdd_block_alloc_info *block_i;
+	struct hdd_reserve_window_node *rsv;
+
+	block_i = kmalloc(sizeof(*block_i), GFP_NOFS);
+	if (block_i) {
+		rsv = &block_i->rsv_window_node;
+		rsv->rsv_start = HDD_RESERVE_WINDOW_NOT_ALLOCATED;
+		rsv->rsv_end = HDD_RESERVE_WINDOW_NOT_ALLOCATED;
+
+		/* δԤʱ, Լ¼ϴηλ, ˳дĿ */
+		if (!test_opt(inode->i_sb, RESERVATION))
+			rsv->rsv_goal_size = 0;
+		else
+			rsv->rsv_goal_size = HDD_DEFAULT_RESERVE_BLOCKS;
+		rsv->rsv_alloc_hit = 0;
+		mutex_init(&block_i->rsv_mutex);
+		block_i->last_alloc_logical_block = 0;
+		block_i->last_alloc_physical_block = 0;
+	}
+	hi->i_block_alloc_info = block_i;
+}
+
+/* ͷ inode Ԥ: رļ, ضϻͷ inode ʱ */
+void hdd_discard_reservation(struct inode *inode)
+{
+	struct hdd_block_alloc_info *block_i = HDD_I(inode)->i_block_alloc_info;
+	struct hdd_reserve_window_node *rsv;
+	spinlock_t *rsv_lock = &HDD_SB(inode->i_sb)->s_rsv_window_lock;
+
+	if (!block_i)
+		return;
+
+	rsv = &block_i->rsv_window_node;
+	mutex_lock(&block_i->rsv_mutex);
+	if (!rsv_is_empty(rsv)) {
+		spin_lock(rsv_lock);
+		if (!rsv_is_empty(rsv))
+			rsv_window_remove(inode->i_sb, rsv);
+		spin_unlock(rsv_lock);
+	}
+	mutex_unlock(&block_i->rsv_mutex);
+}
+
+/*  search_head ʼ,  [start_block, last_block] Ϊ my_rsv һ϶,
+   ߳ s_rsv_window_lock; ɹ 0, ʧܷ -1 */
+static int find_next_reservable_window(
+	struct hdd_reserve_window_node *search_head,
+	struct hdd_reserve_window_node *my_rsv,
+	struct super_block *sb,
+	unsigned int start_block, unsigned int last_block)
+{
+	struct rb_node *next;
+	struct hdd_reserve_window_node *rsv, *prev;
+	unsigned int cur;
+	int size = my_rsv->rsv_goal_size;
+
+	cur = start_block;
+	rsv = search_head;
+	if (!rsv)
+		return -1;
+
+	while (1) {
+		if (cur <= rsv->rsv_end)
+			cur = rsv->rsv_end + 1;
+
+		/* , Ҳ */
+		if (cur > last_block)
+			return -1;
+
+		prev = rsv;
+		next = rb_next(&rsv->rsv_node);
+		if (!next) /* ѵβ, ֮󶼿 */
+			break;
+
+		rsv = rb_entry(next, struct hdd_reserve_window_node, rsv_node);
+		if (cur + size <= rsv->rsv_start) /* ҵ㹻Ŀ϶ */
+			break;
+	}
+
+	/* ϶Լľɴ֮, ԭƶ, ȡ¾ɴ */
+	if (prev != my_rsv && !rsv_is_empty(my_rsv))
+		rsv_window_remove(sb, my_rsv);
+
+	my_rsv->rsv_start = cur;
+	my_rsv->rsv_end = cur + size - 1;
+	my_rsv->rsv_alloc_hit = 0;
+
+	if (prev != my_rsv)
+		hdd_rsv_window_add(sb, my_rsv);
+
+	return 0;
+}
+
+/* ڿ group Ϊ my_rsv ´, Ҫһп */
+static int alloc_new_reservation(struct hdd_reserve_window_node *my_rsv,
+	int grp_goal, struct super_block *sb,
+	unsigned int group, struct buffer_head *bitmap_bh)
+{
+	struct hdd_reserve_window_node *search_head;
+	unsigned int group_first_block, group_end_block, start_block;
+	int first_free_block;
+	unsigned long size;
+	int ret;
+	struct rb_root *fs_rsv_root = &HDD_SB(sb)->s_rsv_window_root;
+	spinlock_t *rsv_lock = &HDD_SB(sb)->s_rsv_window_lock;
+
+	group_first_block = hdd_group_data_first_block(sb, group);
+	group_end_block = group_first_block +
+		hdd_group_data_blocks(sb, group) - 1;
+
+	if (grp_goal < 0)
+		start_block = group_first_block;
+	else
+		start_block = grp_goal + group_first_block;
+
+	size = my_rsv->rsv_goal_size;
+	if (!rsv_is_empty(my_rsv)) {
+		/* ɴõһ, ˵дÿ, ڼӱ */
+		if (my_rsv->rsv_alloc_hit >
+		    (my_rsv->rsv_end - my_rsv->rsv_start + 1) / 2) {
+			size = size * 2;
+			if (size > HDD_MAX_RESERVE_BLOCKS)
+				size = HDD_MAX_RESERVE_BLOCKS;
+			my_rsv->rsv_goal_size = size;
+		}
+	}
+
+	spin_lock(rsv_lock);
+	search_head = search_reserve_window(fs_rsv_root, start_block);
+
+retry:
+	ret = find_next_reservable_window(search_head, my_rsv, sb,
+					  start_block, group_end_block);
+	if (ret == -1) {
+		if (!rsv_is_empty(my_rsv))
+			rsv_window_remove(sb, my_rsv);
+		spin_unlock(rsv_lock);
+		return -1;
+	}
+	spin_unlock(rsv_lock);
+
+	/* ȷϴпп */
+	first_free_block = hdd_fext_next_free(sb, group,
+			my_rsv->rsv_start - group_first_block);
+	if (first_free_block == HDD_FEXT_NOINDEX)
+		first_free_block = bitmap_search_next_usable_block(
+			my_rsv->rsv_start - group_first_block,
+			bitmap_bh, group_end_block - group_first_block + 1);
+
+	if (first_free_block < 0) { /* ֮ûпп */
+		spin_lock(rsv_lock);
+		if (!rsv_is_empty(my_rsv))
+			rsv_window_remove(sb, my_rsv);
+		spin_unlock(rsv_lock);
+		return -1;
+	}
+
+	start_block = first_free_block + group_first_block;
+	if (start_block >= my_rsv->rsv_start && start_block <= my_rsv->rsv_end)
+		return 0;
+
+	/* ȫѷ, ׸п鴦Ҵ */
+	search_head = my_rsv;
+	spin_lock(rsv_lock);
+	goto retry;
+}
+
+/* ʣ鲻ηʱ, չ */
+static void try_to_extend_reservation(struct hdd_reserve_window_node *my_rsv,
+	struct super_block *sb, int size)
+{
+	struct hdd_reserve_window_node *next_rsv;
+	struct rb_node *next;
+	spinlock_t *rsv_lock = &HDD_SB(sb)->s_rsv_window_lock;
+
+	if (!spin_trylock(rsv_lock))
+		return;
+
+	next = rb_next(&my_rsv->rsv_node);
+	if (!next)
+		my_rsv->rsv_end += size;
+	else {
+		next_rsv = rb_entry(next, struct hdd_reserve_window_node,
+				    rsv_node);
+		if (next_rsv->rsv_start - my_rsv->rsv_end - 1 >= size)
+			my_rsv->rsv_end += size;
+		else
+			my_rsv->rsv_end = next_rsv->rsv_start - 1;
+	}
+	spin_unlock(rsv_lock);
+}
+
 /* Է count  */
 static int hdd_try_to_alloc(struct super_block *sb, unsigned int group,
-	struct buffer_head *bitmap_bh, int grp_goal, unsigned long *count)
+	struct buffer_head *bitmap_bh, int grp_goal, unsigned long *count,
+	struct hdd_reserve_window_node *my_rsv)
 {
-//@grp_goal: ڿеԿ
+/* @grp_goal: Ŀλ, ڿ׸ݿĿ, < 0 ʾָ
+ * @my_rsv: Ԥ, Ϊ NULL ʱֻڴڷ
+ * ׸λ */
 
-	//unsigned int group_first_block = 0;
-       	int start = 0, end = 0;
+	unsigned int group_first_block = hdd_group_data_first_block(sb, group);
+	int start = 0, end = 0;
 	unsigned long num = 0;
 	int i = 0;
-	int offset = HDD_SB(sb)->grp_data_offset;
-
-	if (grp_goal < offset)
-		start = offset;
-	else
-		start = grp_goal;
-	start -= offset;
+	int ret;
+
+	end = hdd_group_data_blocks(sb, group);
+	if (my_rsv) {
+		start = my_rsv->rsv_start - group_first_block;
+		if (start < 0)
+			start = 0;
+		if (my_rsv->rsv_end - group_first_block + 1 < end)
+			end = my_rsv->rsv_end - group_first_block + 1;
+	}
 
-	end = HDD_BLOCKS_PER_GROUP(sb) - offset;
+	/* Ȳ extent , ڴʱѡ */
+	ret = hdd_fext_alloc(sb, group, bitmap_bh, grp_goal, start, end,
+			     count, my_rsv == NULL);
+	if (ret != HDD_FEXT_NOINDEX)
+		return ret;
+
+	if (my_rsv) {
+		if (start <= grp_goal && grp_goal < end)
+			start = grp_goal;
+		else
+			grp_goal = -1;
+	} else {
+		if (grp_goal > 0)
+			start = grp_goal;
+		else
+			start = 0;
+	}
 
-	BUG_ON(start > HDD_BLOCKS_PER_GROUP(sb));
+	BUG_ON(start > end);
 
 repeat:
 	if (grp_goal < 0) { /* δָĿķʽҿλ */
@@ -270,9 +592,9 @@ repeat:
 		if (grp_goal < 0)
 			goto fail_access;/* ʧ */
 
-		/* ҵλǰ, ûпλ */
+		/* ҵλǰ, ûпλ; 򲻱 */
 		i = 0; 
-		while (i < 7 && grp_goal > start
+		while (!my_rsv && i < 7 && grp_goal > start
 		&& !test_bit(grp_goal - 1, (unsigned long *)bitmap_bh->b_data)){
 			i++;
 			grp_goal--;
@@ -295,7 +617,7 @@ repeat:
 	grp_goal++;
 	while (num < *count && grp_goal < end
 	/* ȥ */
-	&& !ext2_set_bit_atomic(sb_bgl_lock(EXT2_SB(sb), group),
+	&& !ext2_set_bit_atomic(sb_bgl_lock(HDD_SB(sb), group),
 		grp_goal, bitmap_bh->b_data)) {
 		num++;
 		grp_goal++;
@@ -310,14 +632,72 @@ fail_access:
 	return -1;
 }
 
+/* Ԥз, ҪʱȽչ */
+static int hdd_try_to_alloc_with_rsv(struct super_block *sb,
+	unsigned int group, struct buffer_head *bitmap_bh, int grp_goal,
+	struct hdd_reserve_window_node *my_rsv, unsigned long *count)
+{
+	unsigned int group_first_block, group_last_block;
+	unsigned long num = *count;
+	int ret = 0;
+
+	if (!my_rsv) /* ʹԤ */
+		return hdd_try_to_alloc(sb, group, bitmap_bh,
+					grp_goal, count, NULL);
+
+	group_first_block = hdd_group_data_first_block(sb, group);
+	group_last_block = group_first_block +
+		hdd_group_data_blocks(sb, group) - 1;
+
+	/* Ϊ, ϴηʧ, Ŀ겻ڴ, ´;
+	   ʣ, չ */
+	while (1) {
+		if (rsv_is_empty(my_rsv) || ret < 0 ||
+		    !goal_in_my_reservation(my_rsv, grp_goal, group, sb)) {
+			if (my_rsv->rsv_goal_size < *count)
+				my_rsv->rsv_goal_size = *count;
+			ret = alloc_new_reservation(my_rsv, grp_goal, sb,
+						    group, bitmap_bh);
+			if (ret < 0)
+				break;	/* ûд */
+
+			if (!goal_in_my_reservation(my_rsv, grp_goal,
+						    group, sb))
+				grp_goal = -1;
+		} else if (grp_goal >= 0) {
+			int curr = my_rsv->rsv_end -
+				(grp_goal + group_first_block) + 1;
+
+			if (curr < *count)
+				try_to_extend_reservation(my_rsv, sb,
+							  *count - curr);
+		}
+
+		BUG_ON(my_rsv->rsv_start > group_last_block ||
+		       my_rsv->rsv_end < group_first_block);
+
+		ret = hdd_try_to_alloc(sb, group, bitmap_bh, grp_goal,
+				       &num, my_rsv);
+		if (ret >= 0) {
+			my_rsv->rsv_alloc_hit += num;
+			*count = num;
+			break;	/* ɹ */
+		}
+		num = *count;
+	}
+	return ret;
+}
+
 /* ĺĺ - ӽĿ괦 count  */
 unsigned int hdd_new_blocks(struct inode *inode,
-	unsigned int goal, unsigned long *count, int *errp)
+	unsigned int goal, unsigned long *count, int delalloc, int *errp)
 {
 /* @goal: Ŀ
  * @count: ҪĿ
+ * @delalloc: Ϊӳٿд, ʹӳٷԤĿ
  * طĿеһĿ
  *
+ * ļԼԤз, ֮Ŀļ.
  * Ŀ, Ŀ 32 һп, Ǹ;
  * , п: ڿ,	> λͼһֽ, 
  *				> ʧ,  bit.
@@ -337,8 +717,15 @@ unsigned int hdd_new_blocks(struct inode *inode,
 	struct hdd_group_desc *gdp;
 	struct hdd_super_block *hs;
 	struct hdd_sb_info *sbi;
+	struct hdd_reserve_window_node *my_rsv = NULL;
+	struct hdd_block_alloc_info *block_i;
+	struct hdd_block_alloc_info *rsv_locked = NULL;/*  rsv_mutex */
+	s64 avail;			/* ɷĿп */
+	unsigned short windowsz = 0;
 	unsigned long ngroups;
 	unsigned long num = *count;
+	unsigned int need;		/* ժҪѡʱҪ */
+	int next;
 	//unsigned long remain = 0;
 
 	*errp = -ENOSPC;
@@ -352,10 +739,23 @@ unsigned int hdd_new_blocks(struct inode *inode,
 	hs = HDD_SB(sb)->hdd_sb;
 	fmc_debug("goal = %u.\n", goal);
 
-	if (!hdd_has_free_blocks(sbi)) {	/* ȷǷпп */
+	/* ļʹԤ; ͬһļдôʱ,
+	   ֱӰĿ, ȴ */
+	block_i = HDD_I(inode)->i_block_alloc_info;
+	if (block_i && block_i->rsv_window_node.rsv_goal_size > 0
+	&& mutex_trylock(&block_i->rsv_mutex)) {
+		rsv_locked = block_i;
+		windowsz = block_i->rsv_window_node.rsv_goal_size;
+		my_rsv = &block_i->rsv_window_node;
+	}
+
+	avail = hdd_has_free_blocks(sbi, delalloc);
+	if (!avail) {			/* ȷǷпп */
 		*errp = -ENOSPC;
 		goto out;
 	}
+	if (num > avail)		/* ռӳٷԤĿ */
+		num = avail;
 
 	/* ȼ齨ĿǷϷ */
 	if (goal < le32_to_cpu(hs->s_first_data_block) ||
@@ -367,26 +767,36 @@ unsigned int hdd_new_blocks(struct inode *inode,
 	group_no = (goal - le32_to_cpu(hs->s_first_data_block)) /
 		sbi->blks_per_group;
 	goal_group = group_no;/* Ŀ */
-
+retry_alloc:
+	need = my_rsv ? windowsz : num;
 	gdp = hdd_get_group_desc(sb, group_no, &gdp_bh); /* ȡ */
 	if (!gdp)
 		goto io_error;
 
 	free_blocks = le32_to_cpu(gdp->bg_free_blocks_count);/* п */
 
+	/* пп鲻һ, һûд, 򱾴βô */
+	if (my_rsv && free_blocks < windowsz && free_blocks > 0
+	&& rsv_is_empty(my_rsv))
+		my_rsv = NULL;
+
 	/* пп */
 	if (free_blocks > 0) {
-		/* ԵĿ */
+		/* ԵĿλ: ĿԪʱ, ׸ݿ鿪ʼ */
 		grp_target_blk = ((goal - le32_to_cpu(hs->s_first_data_block))
 			% sbi->blks_per_group);
+		if (grp_target_blk < sbi->grp_data_offset)
+			grp_target_blk = 0;
+		else
+			grp_target_blk -= sbi->grp_data_offset;
 
 		bitmap_bh = read_block_bitmap(sb, group_no);/* ȡÿλͼ */
 		if (!bitmap_bh)
 			goto io_error;
 
 		/* ԽзĿ */
-		grp_alloc_blk = hdd_try_to_alloc(sb, group_no,
-				bitmap_bh, grp_target_blk, &num);
+		grp_alloc_blk = hdd_try_to_alloc_with_rsv(sb, group_no,
+				bitmap_bh, grp_target_blk, my_rsv, &num);
 		if (grp_alloc_blk >= 0)
 			goto allocated;/*  */
 	}
@@ -395,16 +805,26 @@ unsigned int hdd_new_blocks(struct inode *inode,
 	ngroups = sbi->groups_count;
 	smp_rmb();
 
-	/* п */
+retry_groups:
+	/* ժҪ, ֻȡжοĿ */
 	for (bgi = 0; bgi < ngroups; bgi++) {
-		group_no++;
-		if (group_no >= ngroups)
-			group_no = 0;
+		next = hdd_fext_next_group(sb, (group_no + 1) % ngroups, need);
+		if (next < 0)
+			break;
+		bgi += (next + ngroups - group_no - 1) % ngroups;
+		if (bgi >= ngroups)
+			break;
+		group_no = next;
 		gdp = hdd_get_group_desc(sb, group_no, &gdp_bh); /* ȡ */
 		if (!gdp)
 			goto io_error;
 
 		free_blocks = le32_to_cpu(gdp->bg_free_blocks_count);
+		/* ûпп, п鲻ڵĿ */
+		if (!free_blocks)
+			continue;
+		if (my_rsv && free_blocks <= (windowsz / 2))
+			continue;
 
 		brelse(bitmap_bh);
 		bitmap_bh = read_block_bitmap(sb, group_no);/* ȡÿλͼ */
@@ -412,12 +832,29 @@ unsigned int hdd_new_blocks(struct inode *inode,
 			goto io_error;
 
 		/* ԲָڴĿķʽԷ */
-		grp_alloc_blk = hdd_try_to_alloc(sb, group_no,
-					bitmap_bh, -1, &num);
+		grp_alloc_blk = hdd_try_to_alloc_with_rsv(sb, group_no,
+					bitmap_bh, -1, my_rsv, &num);
 		if (grp_alloc_blk >= 0)
 			goto allocated;
 	}
 
+	/* û㹻Ŀж, п */
+	if (!my_rsv && need > 1) {
+		need = 1;
+		group_no = goal_group;
+		goto retry_groups;
+	}
+
+	/* ʹôʱʧ, ôһ, ʱпܺ */
+	if (my_rsv) {
+		my_rsv = NULL;
+		windowsz = 0;
+		group_no = goal_group;
+		brelse(bitmap_bh);	/* ʱ¶ȡĿλͼ */
+		bitmap_bh = NULL;
+		goto retry_alloc;
+	}
+
 	/* 豸ûпп */
 	*errp = -ENOSPC;
 	goto out;
@@ -452,6 +889,8 @@ allocated: /* 
 
 	*errp = 0;
 	brelse(bitmap_bh); /* ͷ buffer */
+	if (rsv_locked)
+		mutex_unlock(&rsv_locked->rsv_mutex);
 
 	*count = num; /* ¼ѷ */
 
@@ -461,5 +900,7 @@ io_error:
 	*errp = -EIO;
 out:
 	brelse(bitmap_bh);
+	if (rsv_locked)
+		mutex_unlock(&rsv_locked->rsv_mutex);
 	return 0;
 }
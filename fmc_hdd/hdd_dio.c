@@ -0,0 +1,303 @@
+/*
+ * fmcfs/fmc_hdd/hdd_dio.c
+ *
+ * Copyright (C) 2013 by Xuesen Liang, <liangxuesen@gmail.com>
+ * @ Beijing University of Posts and Telecommunications,
+ * @ CPU & SoC Center of Tsinghua University.
+ *
+ * This program can be redistributed under the terms of the GNU Public License.
+ */
+
+/*
+ * ֱֲ I/O.
+ *
+ * blockdev_direct_IO ֻжܷ뵱ǰ bio, Ƚ豸,
+ * 豸Ͽǡӵλᱻͬһ bio, 豸;
+ * Ϊÿһ get_block, ʹûͷӳ. ļ
+ * hdd_map_blocks ȡӳ(ÿδ豸), Ϊÿν bio, ͬʱ
+ * ύ HDD  SSD; ȫ bio ɺһν, 첽
+ * aio_complete.
+ *
+ * ֻҳ, ȫд, ҲԽļβ. ն, δд
+ * չļʱ -ENOTBLK, ɵ߽ blockdev_direct_IO. ֻ
+ *  HDD:  get_block  SSD ϵĿ鱨Ϊδӳ, дڴ˽,
+ * ಿɻд; δӳĿΪ, ˵
+ * hdd_dio_on_ssd , 漰 SSD ʱû.
+ *
+ *  O_NONBLOCK 򿪵ļ, ַ鲻ȫڴʱ -EAGAIN, ύ
+ * ΪԪݵȴ HDD Ѱ. ʱӳӳ仺, ύʱ
+ * ٶַ; 鲻, ÿķֻύʱһ.
+ */
+
+#include <linux/fs.h>
+#include <linux/aio.h>
+#include <linux/bio.h>
+#include <linux/uio.h>
+#include <linux/slab.h>
+#include <linux/pagemap.h>
+#include <linux/completion.h>
+#include <linux/buffer_head.h>
+
+#include "hdd.h"
+
+#define HDD_DIO_PAGES	64	/* ÿûҳ */
+
+struct hdd_dio {
+	struct kiocb		*iocb;
+	struct inode		*inode;
+	int			rw;
+	ssize_t			size;		/* ֽ */
+	atomic_t		refcount;	/* δɵ bio , ύһ */
+	int			error;
+	struct completion	done;		/* ͬڴ˵ȴ */
+};
+
+/* ȫ bio  */
+static void hdd_dio_complete(struct hdd_dio *dio)
+{
+	ssize_t ret = dio->error ? dio->error : dio->size;
+
+	up_read_non_owner(&dio->inode->i_alloc_sem);
+
+	if (is_sync_kiocb(dio->iocb)) {
+		complete(&dio->done);	/* ύͷ dio */
+		return;
+	}
+	aio_complete(dio->iocb, ret, 0);
+	kfree(dio);
+}
+
+static inline void hdd_dio_put(struct hdd_dio *dio)
+{
+	if (atomic_dec_and_test(&dio->refcount))
+		hdd_dio_complete(dio);
+}
+
+static void hdd_dio_end_io(struct bio *bio, int error)
+{
+	struct hdd_dio *dio = bio->bi_private;
+	struct bio_vec *bvec;
+	int i;
+
+	if (!error && !test_bit(BIO_UPTODATE, &bio->bi_flags))
+		error = -EIO;
+	if (error)
+		dio->error = error;
+
+	if (dio->rw == READ) {
+		bio_check_pages_dirty(bio);	/* ͷҳ bio */
+	} else {
+		bio_for_each_segment(bvec, bio, i)
+			page_cache_release(bvec->bv_page);
+		bio_put(bio);
+	}
+	hdd_dio_put(dio);
+}
+
+static void hdd_dio_submit(struct hdd_dio *dio, struct bio *bio)
+{
+	atomic_inc(&dio->refcount);
+	if (dio->rw == READ)
+		bio_set_pages_dirty(bio);	/* ʱټһ */
+	submit_bio(dio->rw, bio);
+}
+
+/* [iblock, iblock + nr) Ƿȫд; nowait ʱַ鲻ڴ淵 -EAGAIN */
+static int hdd_dio_mapped_range(struct inode *inode, sector_t iblock,
+	unsigned long nr, int nowait)
+{
+	struct hdd_map_blocks map;
+	int ret;
+
+	while (nr) {
+		map.m_lblk = iblock;
+		map.m_len = nr;
+		ret = hdd_map_blocks(inode, &map, HDD_GET_BLOCKS_NOACCT |
+				     (nowait ? HDD_GET_BLOCKS_NOWAIT : 0));
+		if (ret == -EAGAIN && nowait)
+			return ret;
+		if (ret <= 0)
+			return 0;
+
+		iblock += map.m_len;
+		nr -= map.m_len;
+	}
+	return 1;
+}
+
+/*  [offset, offset + size) ļβ֮ǰĲǷ SSD ϵĿ */
+int hdd_dio_on_ssd(struct inode *inode, loff_t offset, size_t size)
+{
+	unsigned blkbits = inode->i_blkbits;
+	struct hdd_map_blocks map;
+	sector_t iblock, last;
+	loff_t end;
+
+	end = min_t(loff_t, offset + size, i_size_read(inode));
+	if (offset >= end)
+		return 0;
+	iblock = offset >> blkbits;
+	last = (end + (1 << blkbits) - 1) >> blkbits;
+
+	while (iblock < last) {
+		map.m_lblk = iblock;
+		map.m_len = last - iblock;
+		if (hdd_map_blocks(inode, &map, HDD_GET_BLOCKS_NOACCT) < 0)
+			return 0;	/*  blockdev_direct_IO  */
+		if ((map.m_flags & HDD_MAP_MAPPED) &&
+		    map.m_bdev != inode->i_sb->s_bdev)
+			return 1;
+		iblock += map.m_len;
+	}
+	return 0;
+}
+
+/* blockdev_direct_IO  get_block: SSD ϵĿ鱨Ϊδӳ */
+int hdd_dio_get_block(struct inode *inode, sector_t iblock,
+	struct buffer_head *bh_result, int create)
+{
+	int ret = hdd_get_block(inode, iblock, bh_result, create);
+
+	if (!ret && buffer_mapped(bh_result) &&
+	    bh_result->b_bdev != inode->i_sb->s_bdev) {
+		clear_buffer_mapped(bh_result);
+		clear_buffer_new(bh_result);
+		clear_buffer_boundary(bh_result);
+	}
+	return ret;
+}
+
+/* 豸зֱֵ I/O, ʱ -ENOTBLK */
+ssize_t hdd_dio_tiered(int rw, struct kiocb *iocb, const struct iovec *iov,
+	loff_t offset, unsigned long nr_segs)
+{
+	struct inode *inode = iocb->ki_filp->f_mapping->host;
+	unsigned blkbits = inode->i_blkbits;
+	struct page *pages[HDD_DIO_PAGES];
+	struct hdd_map_blocks map;
+	struct bio *bio = NULL;
+	struct hdd_dio *dio;
+	sector_t iblock, last;		/* ǰ, ĩ֮ */
+	sector_t pblk = 0;		/* ǰ */
+	unsigned long left = 0;		/* ǰӳʣ */
+	unsigned long seg, addr, nr;
+	size_t size = 0;
+	ssize_t ret;
+	int i, n;
+
+	if (inode->i_sb->s_blocksize != PAGE_SIZE)
+		return -ENOTBLK;
+
+	if (offset & (PAGE_SIZE - 1))
+		return -ENOTBLK;
+	for (seg = 0; seg < nr_segs; seg++) {
+		if (((unsigned long) iov[seg].iov_base | iov[seg].iov_len)
+		    & (PAGE_SIZE - 1))
+			return -ENOTBLK;
+		size += iov[seg].iov_len;
+	}
+	if (!size || offset + size > i_size_read(inode))
+		return -ENOTBLK;
+
+	iblock = offset >> blkbits;
+	last = iblock + (size >> blkbits);
+
+	/* ضϻ, ʱͷ */
+	down_read_non_owner(&inode->i_alloc_sem);
+	ret = hdd_dio_mapped_range(inode, iblock, last - iblock,
+				   iocb->ki_filp->f_flags & O_NONBLOCK);
+	if (ret <= 0) {
+		up_read_non_owner(&inode->i_alloc_sem);
+		return ret ? ret : -ENOTBLK;
+	}
+
+	dio = kzalloc(sizeof(*dio), GFP_KERNEL);
+	if (!dio) {
+		up_read_non_owner(&inode->i_alloc_sem);
+		return -ENOMEM;
+	}
+	dio->iocb = iocb;
+	dio->inode = inode;
+	dio->rw = rw;
+	dio->size = size;
+	atomic_set(&dio->refcount, 1);
+	init_completion(&dio->done);
+
+	for (seg = 0; seg < nr_segs && !dio->error; seg++) {
+		addr = (unsigned long) iov[seg].iov_base;
+		nr = iov[seg].iov_len >> PAGE_SHIFT;
+
+		while (nr && !dio->error) {
+			n = get_user_pages_fast(addr,
+				min_t(unsigned long, nr, HDD_DIO_PAGES),
+				rw == READ, pages);
+			if (n <= 0) {
+				dio->error = n ? n : -EFAULT;
+				break;
+			}
+			addr += (unsigned long) n << PAGE_SHIFT;
+			nr -= n;
+
+			for (i = 0; i < n; i++, iblock++) {
+				if (dio->error) {
+					page_cache_release(pages[i]);
+					continue;
+				}
+
+				/* µӳ: 豸λÿܸı,  bio */
+				if (!left) {
+					map.m_lblk = iblock;
+					map.m_len = last - iblock;
+					if (hdd_map_blocks(inode, &map, 0) <= 0) {
+						dio->error = -EIO;
+						page_cache_release(pages[i]);
+						continue;
+					}
+					left = map.m_len;
+					pblk = map.m_pblk;
+					if (bio) {
+						hdd_dio_submit(dio, bio);
+						bio = NULL;
+					}
+				}
+
+				if (bio && !bio_add_page(bio, pages[i], PAGE_SIZE, 0)) {
+					hdd_dio_submit(dio, bio);
+					bio = NULL;
+				}
+				if (!bio) {
+					bio = bio_alloc(GFP_KERNEL, min_t(sector_t,
+						last - iblock, BIO_MAX_PAGES));
+					bio->bi_bdev = map.m_bdev;
+					bio->bi_sector = pblk << (blkbits - 9);
+					bio->bi_end_io = hdd_dio_end_io;
+					bio->bi_private = dio;
+					if (!bio_add_page(bio, pages[i], PAGE_SIZE, 0)) {
+						dio->error = -EIO;
+						page_cache_release(pages[i]);
+						continue;
+					}
+				}
+				pblk++;
+				left--;
+			}
+		}
+	}
+	if (bio) {
+		if (bio->bi_vcnt)
+			hdd_dio_submit(dio, bio);
+		else
+			bio_put(bio);
+	}
+
+	if (!is_sync_kiocb(iocb)) {
+		hdd_dio_put(dio);
+		return -EIOCBQUEUED;
+	}
+
+	hdd_dio_put(dio);
+	wait_for_completion(&dio->done);
+	ret = dio->error ? dio->error : dio->size;
+	kfree(dio);
+	return ret;
+}
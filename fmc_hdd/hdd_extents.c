@@ -0,0 +1,912 @@
+/*
+ * fmcfs/fmc_hdd/hdd_extents.c
+ *
+ * Copyright (C) 2013 by Xuesen Liang, <liangxuesen@gmail.com>
+ * @ Beijing University of Posts and Telecommunications,
+ * @ CPU & SoC Center of Tsinghua University.
+ *
+ * This program can be redistributed under the terms of the GNU Public License.
+ */
+
+/*
+ * extent ӳ:  HDD_EXTENTS_FL ļʹ 798 ַļӿ,
+ *  [߼, , , λ] ¼һĿ.
+ *  i_data (4 ), ڵռһ(340 ).
+ * ҶڵΪ hdd_extent, ڵΪ hdd_extent_idx, ߶Ϊ 12 ֽ,
+ * ׸ֶζ߼, ˷ѽڵʱɰͬķʽ.
+ */
+
+#include <linux/fs.h>
+#include <linux/sched.h>
+#include <linux/buffer_head.h>
+
+#include "hdd.h"
+
+/* ·еһ */
+struct hdd_ext_path {
+	struct buffer_head	 *p_bh;		/* ڵڿ, ڵΪ NULL */
+	struct hdd_extent_header *p_hdr;	/* ڵͷ */
+	struct hdd_extent	 *p_ext;	/* Ҷڵ <= Ŀһ */
+	struct hdd_extent_idx	 *p_idx;	/* ڵ <= Ŀһ */
+};
+
+#define EXT_FIRST_EXTENT(h)	((struct hdd_extent *)((h) + 1))
+#define EXT_FIRST_INDEX(h)	((struct hdd_extent_idx *)((h) + 1))
+#define EXT_LAST_EXTENT(h)	(EXT_FIRST_EXTENT(h) + \
+				 le16_to_cpu((h)->eh_entries) - 1)
+#define EXT_LAST_INDEX(h)	(EXT_FIRST_INDEX(h) + \
+				 le16_to_cpu((h)->eh_entries) - 1)
+#define EXT_ENTRY_SIZE		sizeof(struct hdd_extent)
+
+/* ڵͷ */
+static inline struct hdd_extent_header *ext_inode_hdr(struct inode *inode)
+{
+	return (struct hdd_extent_header *) HDD_I(inode)->i_data;
+}
+
+/*  */
+static inline int ext_depth(struct inode *inode)
+{
+	return le16_to_cpu(ext_inode_hdr(inode)->eh_depth);
+}
+
+/* ڵǷ */
+static inline int ext_node_full(struct hdd_extent_header *eh)
+{
+	return le16_to_cpu(eh->eh_entries) >= le16_to_cpu(eh->eh_max);
+}
+
+/* ڵͿڵпɵ */
+static inline int ext_root_max(void)
+{
+	return (sizeof(((struct hdd_inode_info *)0)->i_data) -
+		sizeof(struct hdd_extent_header)) / EXT_ENTRY_SIZE;
+}
+
+static inline int ext_block_max(void)
+{
+	return (HDD_BLOCK_SIZE - sizeof(struct hdd_extent_header))
+		/ EXT_ENTRY_SIZE;
+}
+
+static inline unsigned int ext_end(struct hdd_extent *ex)
+{
+	return le32_to_cpu(ex->ee_block) + le16_to_cpu(ex->ee_len);
+}
+
+/* ʼյ extent  */
+void hdd_ext_tree_init(struct inode *inode)
+{
+	struct hdd_extent_header *eh = ext_inode_hdr(inode);
+
+	memset(HDD_I(inode)->i_data, 0, sizeof(HDD_I(inode)->i_data));
+	eh->eh_magic = cpu_to_le16(HDD_EXT_MAGIC);
+	eh->eh_entries = 0;
+	eh->eh_max = cpu_to_le16(ext_root_max());
+	eh->eh_depth = 0;
+	mark_inode_dirty(inode);
+}
+
+/* ڵͷǷϷ */
+static int hdd_ext_check_header(struct inode *inode,
+	struct hdd_extent_header *eh, int depth)
+{
+	const char *msg = NULL;
+
+	if (le16_to_cpu(eh->eh_magic) != HDD_EXT_MAGIC)
+		msg = "invalid magic";
+	else if (le16_to_cpu(eh->eh_depth) != depth)
+		msg = "unexpected depth";
+	else if (le16_to_cpu(eh->eh_max) == 0)
+		msg = "invalid eh_max";
+	else if (le16_to_cpu(eh->eh_entries) > le16_to_cpu(eh->eh_max))
+		msg = "invalid eh_entries";
+
+	if (!msg)
+		return 0;
+
+	hdd_msg(inode->i_sb, KERN_ERR, "hdd_ext_check_header",
+		"bad extent header in inode %lu: %s - magic %x, entries %u, "
+		"max %u, depth %u(%d)", inode->i_ino, msg,
+		le16_to_cpu(eh->eh_magic), le16_to_cpu(eh->eh_entries),
+		le16_to_cpu(eh->eh_max), le16_to_cpu(eh->eh_depth), depth);
+	return -EIO;
+}
+
+/*  inode еĸڵ, hdd_iget  */
+int hdd_ext_check_inode(struct inode *inode)
+{
+	int depth = ext_depth(inode);
+
+	if (depth > HDD_EXT_MAX_DEPTH)
+		return -EIO;
+	return hdd_ext_check_header(inode, ext_inode_hdr(inode), depth);
+}
+
+/* ͷ·ϵĻ */
+static void hdd_ext_drop_path(struct hdd_ext_path *path)
+{
+	int i;
+
+	for (i = 0; i <= HDD_EXT_MAX_DEPTH; i++) {
+		if (path[i].p_bh)
+			brelse(path[i].p_bh);
+		path[i].p_bh = NULL;
+	}
+}
+
+/* ·е level ĽڵΪ */
+static void hdd_ext_dirty(struct inode *inode, struct hdd_ext_path *path)
+{
+	if (path->p_bh)
+		mark_buffer_dirty_inode(path->p_bh, inode);
+	else
+		mark_inode_dirty(inode);
+}
+
+/* ڵжֲ <= block һ, ûȡ */
+static void hdd_ext_binsearch_idx(struct hdd_ext_path *path, unsigned int block)
+{
+	struct hdd_extent_idx *l, *r, *m;
+
+	l = EXT_FIRST_INDEX(path->p_hdr) + 1;
+	r = EXT_LAST_INDEX(path->p_hdr);
+	while (l <= r) {
+		m = l + (r - l) / 2;
+		if (block < le32_to_cpu(m->ei_block))
+			r = m - 1;
+		else
+			l = m + 1;
+	}
+	path->p_idx = l - 1;
+}
+
+/* Ҷڵжֲ <= block һ, ûΪ NULL */
+static void hdd_ext_binsearch(struct hdd_ext_path *path, unsigned int block)
+{
+	struct hdd_extent *l, *r, *m;
+
+	path->p_ext = NULL;
+	if (!path->p_hdr->eh_entries)
+		return;
+
+	l = EXT_FIRST_EXTENT(path->p_hdr);
+	r = EXT_LAST_EXTENT(path->p_hdr);
+	if (block < le32_to_cpu(l->ee_block))
+		return;
+
+	l++;
+	while (l <= r) {
+		m = l + (r - l) / 2;
+		if (block < le32_to_cpu(m->ee_block))
+			r = m - 1;
+		else
+			l = m + 1;
+	}
+	path->p_ext = l - 1;
+}
+
+/* Ӹ² block ڵҶڵ, ·¼ path[0..depth]  */
+static int hdd_ext_find_extent(struct inode *inode, unsigned int block,
+	struct hdd_ext_path *path)
+{
+	struct hdd_extent_header *eh = ext_inode_hdr(inode);
+	struct buffer_head *bh;
+	int depth = le16_to_cpu(eh->eh_depth);
+	int level = 0;
+
+	memset(path, 0, sizeof(*path) * (HDD_EXT_MAX_DEPTH + 1));
+	path[0].p_hdr = eh;
+
+	for (level = 0; level < depth; level++) {
+		if (!path[level].p_hdr->eh_entries)
+			goto corrupt;
+		hdd_ext_binsearch_idx(&path[level], block);
+
+		bh = sb_bread(inode->i_sb,
+			      le32_to_cpu(path[level].p_idx->ei_leaf));
+		if (!bh) {
+			hdd_ext_drop_path(path);
+			return -EIO;
+		}
+		path[level + 1].p_bh = bh;
+		path[level + 1].p_hdr = (struct hdd_extent_header *) bh->b_data;
+		if (hdd_ext_check_header(inode, path[level + 1].p_hdr,
+					 depth - level - 1))
+			goto corrupt;
+	}
+
+	hdd_ext_binsearch(&path[depth], block);
+	return 0;
+
+corrupt:
+	hdd_ext_drop_path(path);
+	return -EIO;
+}
+
+/* path Ҳһ extent ʼ߼, ·ĳ */
+static unsigned int hdd_ext_next_allocated(struct hdd_ext_path *path,
+	int depth)
+{
+	struct hdd_extent_header *eh = path[depth].p_hdr;
+	struct hdd_extent *ex = path[depth].p_ext;
+
+	if (!ex && eh->eh_entries)
+		return le32_to_cpu(EXT_FIRST_EXTENT(eh)->ee_block);
+	if (ex && ex < EXT_LAST_EXTENT(eh))
+		return le32_to_cpu((ex + 1)->ee_block);
+
+	/* Ҷڵû, ϲеһ */
+	while (--depth >= 0) {
+		if (path[depth].p_idx < EXT_LAST_INDEX(path[depth].p_hdr))
+			return le32_to_cpu((path[depth].p_idx + 1)->ei_block);
+	}
+	return HDD_EXT_MAX_BLOCK;
+}
+
+/*  extent е iblock ӳ䵽 bh , ӳĿ */
+static int hdd_ext_map_bh(struct inode *inode, struct hdd_extent *ex,
+	unsigned int iblock, unsigned long maxblocks, struct buffer_head *bh)
+{
+	struct super_block *sb = inode->i_sb;
+	unsigned int pblk = le32_to_cpu(ex->ee_start) +
+		(iblock - le32_to_cpu(ex->ee_block));
+	unsigned long count = ext_end(ex) - iblock;
+
+	if (count > maxblocks)
+		count = maxblocks;
+
+	if (le16_to_cpu(ex->ee_flags) & HDD_EXT_ON_SSD) {
+		set_buffer_mapped(bh);
+		bh->b_bdev = HDD_SB(sb)->ssd_bdev;
+		bh->b_blocknr = pblk;
+		bh->b_size = sb->s_blocksize;
+	} else {
+		map_bh(bh, sb, pblk);
+	}
+	return count;
+}
+
+/* ȷΪ iblock ʱĽĿ */
+static unsigned int hdd_ext_find_goal(struct inode *inode,
+	struct hdd_ext_path *path, int depth, unsigned int iblock)
+{
+	struct hdd_inode_info *hi = HDD_I(inode);
+	struct hdd_block_alloc_info *block_i = hi->i_block_alloc_info;
+	struct hdd_extent *ex = path[depth].p_ext;
+	unsigned int bg_start;
+	unsigned int colour;
+
+	/* ˳׷ʱ, ϴηĿ֮ */
+	if (block_i && iblock == block_i->last_alloc_logical_block + 1
+	&& block_i->last_alloc_physical_block != 0)
+		return block_i->last_alloc_physical_block + 1;
+
+	/* ǰһ HDD ϵ extent ֮ */
+	if (ex && !(le16_to_cpu(ex->ee_flags) & HDD_EXT_ON_SSD))
+		return le32_to_cpu(ex->ee_start) +
+			(iblock - le32_to_cpu(ex->ee_block));
+
+	/* Ҷڵڿ֮ */
+	if (path[depth].p_bh)
+		return path[depth].p_bh->b_blocknr;
+
+	/* ļĵһ, ͬ hdd_find_goal */
+	bg_start = hdd_group_first_block_no(inode->i_sb, hi->i_block_group);
+	colour = (current->pid % 16) * (HDD_BLOCK_SIZE >> 4);
+	return bg_start + HDD_SB(inode->i_sb)->grp_data_offset + colour;
+}
+
+/*  extent b ܷ a ֮ */
+static inline int hdd_ext_can_merge(struct hdd_extent *a, struct hdd_extent *b)
+{
+	return ext_end(a) == le32_to_cpu(b->ee_block)
+	    && le32_to_cpu(a->ee_start) + le16_to_cpu(a->ee_len) ==
+	       le32_to_cpu(b->ee_start)
+	    && a->ee_flags == b->ee_flags
+	    && le16_to_cpu(a->ee_len) + le16_to_cpu(b->ee_len) <=
+	       HDD_EXT_MAX_LEN;
+}
+
+/* һڵ */
+static struct buffer_head *hdd_ext_new_node(struct inode *inode,
+	unsigned int goal, int *err)
+{
+	struct buffer_head *bh;
+	unsigned long count = 1;
+	unsigned int block;
+
+	block = hdd_new_blocks(inode, goal, &count, 0, err);
+	if (*err)
+		return NULL;
+
+	bh = sb_getblk(inode->i_sb, block);
+	if (!bh) {
+		hdd_free_blocks(inode, block, 1);
+		*err = -EIO;
+		return NULL;
+	}
+
+	lock_buffer(bh);
+	memset(bh->b_data, 0, HDD_BLOCK_SIZE);
+	return bh;	/* ʱ bh  */
+}
+
+/* ڵ: ѸڵƵ¿, ڵΪֻһڵ */
+static int hdd_ext_grow_indepth(struct inode *inode)
+{
+	struct hdd_extent_header *root = ext_inode_hdr(inode);
+	struct hdd_extent_header *neh;
+	struct hdd_extent_idx *idx;
+	struct buffer_head *bh;
+	int depth = ext_depth(inode);
+	int err = 0;
+
+	if (depth >= HDD_EXT_MAX_DEPTH)
+		return -EFBIG;
+
+	bh = hdd_ext_new_node(inode, hdd_group_first_block_no(inode->i_sb,
+				HDD_I(inode)->i_block_group), &err);
+	if (!bh)
+		return err;
+
+	/* ½ڵиƸڵ */
+	memcpy(bh->b_data, root, sizeof(HDD_I(inode)->i_data));
+	neh = (struct hdd_extent_header *) bh->b_data;
+	neh->eh_max = cpu_to_le16(ext_block_max());
+
+	set_buffer_uptodate(bh);
+	unlock_buffer(bh);
+	mark_buffer_dirty_inode(bh, inode);
+
+	/* ڵָֻ½ڵһ */
+	idx = EXT_FIRST_INDEX(root);
+	idx->ei_block = neh->eh_entries ?
+		EXT_FIRST_INDEX(neh)->ei_block : 0;
+	idx->ei_leaf = cpu_to_le32(bh->b_blocknr);
+	idx->ei_pad = 0;
+	root->eh_entries = cpu_to_le16(1);
+	root->eh_max = cpu_to_le16(ext_root_max());
+	root->eh_depth = cpu_to_le16(depth + 1);
+
+	brelse(bh);
+	mark_inode_dirty(inode);
+	return 0;
+}
+
+/* ·е at ڵ, 丸ڵ(at-1)пλ */
+static int hdd_ext_split_node(struct inode *inode, struct hdd_ext_path *path,
+	int at, unsigned int block)
+{
+	struct hdd_extent_header *eh = path[at].p_hdr;
+	struct hdd_extent_header *neh;
+	struct hdd_ext_path *parent = path + at - 1;
+	struct hdd_extent_idx *idx;
+	struct buffer_head *bh;
+	int entries = le16_to_cpu(eh->eh_entries);
+	int split = entries / 2;
+	char *first = (char *)(eh + 1);
+	__le32 border;
+	int err = 0;
+
+	/* ˳׷ʱƾ, ʹҶڵ㱣 */
+	if (eh->eh_depth == 0 && entries &&
+	    block >= le32_to_cpu(EXT_LAST_EXTENT(eh)->ee_block))
+		split = entries;
+
+	bh = hdd_ext_new_node(inode, path[at].p_bh->b_blocknr, &err);
+	if (!bh)
+		return err;
+
+	neh = (struct hdd_extent_header *) bh->b_data;
+	neh->eh_magic = cpu_to_le16(HDD_EXT_MAGIC);
+	neh->eh_max = cpu_to_le16(ext_block_max());
+	neh->eh_depth = eh->eh_depth;
+	neh->eh_entries = cpu_to_le16(entries - split);
+	memcpy(neh + 1, first + split * EXT_ENTRY_SIZE,
+	       (entries - split) * EXT_ENTRY_SIZE);
+
+	/* ½ڵ׸߼ */
+	if (split < entries)
+		border = *(__le32 *)(first + split * EXT_ENTRY_SIZE);
+	else
+		border = cpu_to_le32(block);
+
+	set_buffer_uptodate(bh);
+	unlock_buffer(bh);
+	mark_buffer_dirty_inode(bh, inode);
+
+	eh->eh_entries = cpu_to_le16(split);
+	hdd_ext_dirty(inode, path + at);
+
+	/* ڸڵвָ½ڵ */
+	idx = parent->p_idx + 1;
+	memmove(idx + 1, idx, (char *)(EXT_LAST_INDEX(parent->p_hdr) + 1) -
+		(char *)idx);
+	idx->ei_block = border;
+	idx->ei_leaf = cpu_to_le32(bh->b_blocknr);
+	idx->ei_pad = 0;
+	le16_add_cpu(&parent->p_hdr->eh_entries, 1);
+	hdd_ext_dirty(inode, parent);
+
+	brelse(bh);
+	return 0;
+}
+
+/* ֤ block ڵҶڵпλ, Ҫʱѽڵ */
+static int hdd_ext_make_room(struct inode *inode, struct hdd_ext_path *path,
+	unsigned int block)
+{
+	int depth, level, err;
+
+	while (1) {
+		depth = ext_depth(inode);
+
+		/* ¶ϲпλĽڵ */
+		for (level = depth; level >= 0; level--)
+			if (!ext_node_full(path[level].p_hdr))
+				break;
+		if (level == depth)
+			return 0;
+
+		if (level < 0)	/* ȫ,  */
+			err = hdd_ext_grow_indepth(inode);
+		else		/* пλڵ֮µǸڵ */
+			err = hdd_ext_split_node(inode, path, level + 1, block);
+		if (err)
+			return err;
+
+		hdd_ext_drop_path(path);
+		err = hdd_ext_find_extent(inode, block, path);
+		if (err)
+			return err;
+	}
+}
+
+/*  newex , path Ϊ newex->ee_block Ĳ· */
+static int hdd_ext_insert_extent(struct inode *inode,
+	struct hdd_ext_path *path, struct hdd_extent *newex)
+{
+	struct hdd_extent_header *eh;
+	struct hdd_extent *ex, *next;
+	int depth = ext_depth(inode);
+	int err;
+
+	eh = path[depth].p_hdr;
+	ex = path[depth].p_ext;
+
+	/* ǰһ extent ֮ */
+	if (ex && hdd_ext_can_merge(ex, newex)) {
+		le16_add_cpu(&ex->ee_len, le16_to_cpu(newex->ee_len));
+		hdd_ext_dirty(inode, path + depth);
+		return 0;
+	}
+
+	/* ںһ extent ֮ǰ */
+	next = ex ? ex + 1 : EXT_FIRST_EXTENT(eh);
+	if (eh->eh_entries && next <= EXT_LAST_EXTENT(eh)
+	&&  hdd_ext_can_merge(newex, next)) {
+		next->ee_block = newex->ee_block;
+		next->ee_start = newex->ee_start;
+		le16_add_cpu(&next->ee_len, le16_to_cpu(newex->ee_len));
+		hdd_ext_dirty(inode, path + depth);
+		return 0;
+	}
+
+	if (ext_node_full(eh)) {
+		err = hdd_ext_make_room(inode, path,
+					le32_to_cpu(newex->ee_block));
+		if (err)
+			return err;
+		depth = ext_depth(inode);
+		eh = path[depth].p_hdr;
+		ex = path[depth].p_ext;
+	}
+
+	next = ex ? ex + 1 : EXT_FIRST_EXTENT(eh);
+	memmove(next + 1, next,
+		(char *)(EXT_LAST_EXTENT(eh) + 1) - (char *)next);
+	*next = *newex;
+	le16_add_cpu(&eh->eh_entries, 1);
+	hdd_ext_dirty(inode, path + depth);
+	return 0;
+}
+
+/* ² block, ȷҵ extent ʼ ee_block */
+static struct hdd_extent *hdd_ext_refind(struct inode *inode,
+	struct hdd_ext_path *path, unsigned int block, unsigned int ee_block,
+	int *err)
+{
+	struct hdd_extent *ex;
+
+	hdd_ext_drop_path(path);
+	*err = hdd_ext_find_extent(inode, block, path);
+	if (*err)
+		return NULL;
+
+	ex = path[ext_depth(inode)].p_ext;
+	if (!ex || le32_to_cpu(ex->ee_block) != ee_block) {
+		*err = -EIO;
+		return NULL;
+	}
+	return ex;
+}
+
+/*  path ָδд extent е [block, block+count) תΪд.
+ * Ȳ², ԭ, ʧʱһ.
+ * תĿ, < 0 Ϊ */
+static int hdd_ext_convert_unwritten(struct inode *inode,
+	struct hdd_ext_path *path, unsigned int block, unsigned long count)
+{
+	struct hdd_extent *ex = path[ext_depth(inode)].p_ext;
+	struct hdd_extent newex;
+	unsigned int ee_block = le32_to_cpu(ex->ee_block);
+	unsigned int ee_start = le32_to_cpu(ex->ee_start);
+	unsigned int end = ext_end(ex);
+	__le16 flags = ex->ee_flags;
+	int err;
+
+	if (count > end - block)
+		count = end - block;
+
+	/* βδдĲֳΪ */
+	if (block + count < end) {
+		newex.ee_block = cpu_to_le32(block + count);
+		newex.ee_start = cpu_to_le32(ee_start + block + count - ee_block);
+		newex.ee_len = cpu_to_le16(end - block - count);
+		newex.ee_flags = flags;
+		err = hdd_ext_insert_extent(inode, path, &newex);
+		if (err)
+			return err;
+		ex = hdd_ext_refind(inode, path, ee_block, ee_block, &err);
+		if (!ex)
+			return err;
+		ex->ee_len = cpu_to_le16(block + count - ee_block);
+		hdd_ext_dirty(inode, path + ext_depth(inode));
+	}
+
+	/* תĲ: ʱֱӸı־, Ϊ */
+	if (block == ee_block) {
+		ex->ee_flags = cpu_to_le16(le16_to_cpu(flags) &
+					   ~HDD_EXT_UNWRITTEN);
+		hdd_ext_dirty(inode, path + ext_depth(inode));
+		return count;
+	}
+
+	newex.ee_block = cpu_to_le32(block);
+	newex.ee_start = cpu_to_le32(ee_start + block - ee_block);
+	newex.ee_len = cpu_to_le16(count);
+	newex.ee_flags = cpu_to_le16(le16_to_cpu(flags) & ~HDD_EXT_UNWRITTEN);
+	err = hdd_ext_insert_extent(inode, path, &newex);
+	if (err)
+		return err;
+	ex = hdd_ext_refind(inode, path, ee_block, ee_block, &err);
+	if (!ex)
+		return err;
+	ex->ee_len = cpu_to_le16(block - ee_block);
+	hdd_ext_dirty(inode, path + ext_depth(inode));
+	return count;
+}
+
+/* ȡ iblock ʵʿ, ¼ bh_result ,  create ֮.
+ * δд extent ڲʱն,  bh_result Ϊδд; дʱתΪд;
+ * create Ϊ HDD_GET_BLOCKS_PREALLOC ʱ, ·ĿΪδд.
+ * ӳ, 0 ʾն, < 0 Ϊ */
+int hdd_ext_get_blocks(struct inode *inode, sector_t iblock,
+	unsigned long maxblocks, struct buffer_head *bh_result, int create)
+{
+	struct hdd_inode_info *hi = HDD_I(inode);
+	struct hdd_ext_path path[HDD_EXT_MAX_DEPTH + 1];
+	struct hdd_extent *ex;
+	struct hdd_extent newex;
+	unsigned int block = iblock;
+	unsigned int next, goal, pblk;
+	unsigned long count;
+	int delalloc = create & HDD_GET_BLOCKS_DELALLOC;
+	int depth, err;
+
+	create &= ~HDD_GET_BLOCKS_DELALLOC;
+	if (iblock >= HDD_EXT_MAX_BLOCK)
+		return -EFBIG;
+
+	/* ֻز */
+	down_read(&hi->i_data_sem);
+	err = hdd_ext_find_extent(inode, block, path);
+	if (!err) {
+		ex = path[ext_depth(inode)].p_ext;
+		if (ex && block < ext_end(ex)
+		&& (!(le16_to_cpu(ex->ee_flags) & HDD_EXT_UNWRITTEN)
+		    || create == HDD_GET_BLOCKS_PREALLOC)) {
+			clear_buffer_new(bh_result);
+			err = hdd_ext_map_bh(inode, ex, block,
+					     maxblocks, bh_result);
+		} else if (!create && ex && block < ext_end(ex)) {
+			set_buffer_unwritten(bh_result);	/* δд鰴ն */
+		}
+		hdd_ext_drop_path(path);
+	}
+	up_read(&hi->i_data_sem);
+
+	if (err || !create)
+		return err;
+
+	/* Ҫ, ²: ѱ˷ */
+	down_write(&hi->i_data_sem);
+	if (S_ISREG(inode->i_mode) && !hi->i_block_alloc_info)
+		hdd_init_block_alloc_info(inode);
+
+	err = hdd_ext_find_extent(inode, block, path);
+	if (err)
+		goto out;
+
+	depth = ext_depth(inode);
+	ex = path[depth].p_ext;
+	if (ex && block < ext_end(ex)) {
+		clear_buffer_new(bh_result);
+		if ((le16_to_cpu(ex->ee_flags) & HDD_EXT_UNWRITTEN)
+		&& create != HDD_GET_BLOCKS_PREALLOC) {
+			/* дδд: תΪд, δдĲ */
+			err = hdd_ext_convert_unwritten(inode, path, block,
+							maxblocks);
+			if (err < 0)
+				goto out_path;
+			hdd_ext_drop_path(path);
+			err = hdd_ext_find_extent(inode, block, path);
+			if (err)
+				goto out;
+			ex = path[ext_depth(inode)].p_ext;
+			set_buffer_new(bh_result);
+		}
+		err = hdd_ext_map_bh(inode, ex, block, maxblocks, bh_result);
+		goto out_path;
+	}
+
+	/* Ŀ鲻ܸһ extent */
+	next = hdd_ext_next_allocated(path, depth);
+	count = next - block;
+	if (count > maxblocks)
+		count = maxblocks;
+	if (count > HDD_EXT_MAX_LEN)
+		count = HDD_EXT_MAX_LEN;
+
+	goal = hdd_ext_find_goal(inode, path, depth, block);
+	pblk = hdd_new_blocks(inode, goal, &count, delalloc, &err);
+	if (err)
+		goto out_path;
+
+	newex.ee_block = cpu_to_le32(block);
+	newex.ee_start = cpu_to_le32(pblk);
+	newex.ee_len = cpu_to_le16(count);
+	newex.ee_flags = 0;
+	if (create == HDD_GET_BLOCKS_PREALLOC)
+		newex.ee_flags = cpu_to_le16(HDD_EXT_UNWRITTEN);
+	err = hdd_ext_insert_extent(inode, path, &newex);
+	if (err) {
+		hdd_free_blocks(inode, pblk, count);
+		goto out_path;
+	}
+
+	percpu_counter_add(&HDD_SB(inode->i_sb)->usr_blocks, count);
+	if (hi->i_block_alloc_info) { /* ¼ηλ */
+		hi->i_block_alloc_info->last_alloc_logical_block =
+			block + count - 1;
+		hi->i_block_alloc_info->last_alloc_physical_block =
+			pblk + count - 1;
+	}
+
+	inode->i_ctime = CURRENT_TIME_SEC;
+	mark_inode_dirty(inode);
+
+	set_buffer_new(bh_result);
+	err = hdd_ext_map_bh(inode, &newex, block, count, bh_result);
+
+out_path:
+	hdd_ext_drop_path(path);
+out:
+	up_write(&hi->i_data_sem);
+	return err;
+}
+
+/* ͷ extent  [start, start+count) Ӧ */
+static void hdd_ext_free_blocks(struct inode *inode, struct hdd_extent *ex,
+	unsigned int start, unsigned int count)
+{
+	unsigned int pblk = le32_to_cpu(ex->ee_start) +
+		(start - le32_to_cpu(ex->ee_block));
+
+	if (le16_to_cpu(ex->ee_flags) & HDD_EXT_ON_SSD) {
+		hdd_ssd_release_blocks(inode, pblk, count);
+	} else {
+		hdd_free_blocks(inode, pblk, count);
+		percpu_counter_sub(&HDD_SB(inode->i_sb)->usr_blocks, count);
+	}
+}
+
+/* ͷҶڵ [start, end) ཻĲ, ʣ */
+static int hdd_ext_rm_leaf(struct inode *inode, struct hdd_extent_header *eh,
+	unsigned int start, unsigned int end, int *dirty)
+{
+	struct hdd_extent *ex = EXT_FIRST_EXTENT(eh);
+	struct hdd_extent *last = EXT_LAST_EXTENT(eh);
+	struct hdd_extent *to = ex;
+	unsigned int a, b, ee_block, ee_end;
+
+	for (; ex <= last; ex++) {
+		ee_block = le32_to_cpu(ex->ee_block);
+		ee_end = ext_end(ex);
+		a = max(start, ee_block);
+		b = min(end, ee_end);
+
+		if (a < b) {		/* ͷŷΧཻ */
+			*dirty = 1;
+			hdd_ext_free_blocks(inode, ex, a, b - a);
+
+			if (a == ee_block && b == ee_end) {
+				continue;	/* ɾ */
+			} else if (a == ee_block) {	/* ɾͷ */
+				ex->ee_block = cpu_to_le32(b);
+				le32_add_cpu(&ex->ee_start, b - ee_block);
+				ex->ee_len = cpu_to_le16(ee_end - b);
+			} else {		/* ɾβ */
+				ex->ee_len = cpu_to_le16(a - ee_block);
+			}
+		}
+		if (to != ex)
+			*to = *ex;
+		to++;
+	}
+
+	eh->eh_entries = cpu_to_le16(to - EXT_FIRST_EXTENT(eh));
+	return le16_to_cpu(eh->eh_entries);
+}
+
+/* ͷŽڵ [start, end) ཻĲ, upper Ϊڵ㸲ǷΧϽ.
+ * ʣ */
+static int hdd_ext_rm_node(struct inode *inode, struct hdd_extent_header *eh,
+	int depth, unsigned int start, unsigned int end,
+	unsigned int upper, int *dirty)
+{
+	struct hdd_extent_idx *idx;
+	struct hdd_extent_header *ceh;
+	struct buffer_head *bh;
+	unsigned int lower, child_upper;
+	int child_dirty, left;
+
+	if (depth == 0)
+		return hdd_ext_rm_leaf(inode, eh, start, end, dirty);
+
+	/* Ӻǰ, ɾʱƶδ */
+	for (idx = EXT_LAST_INDEX(eh); idx >= EXT_FIRST_INDEX(eh); idx--) {
+		child_upper = (idx == EXT_LAST_INDEX(eh)) ? upper :
+			le32_to_cpu((idx + 1)->ei_block);
+		lower = (idx == EXT_FIRST_INDEX(eh)) ? 0 :
+			le32_to_cpu(idx->ei_block);
+		if (child_upper <= start || lower >= end)
+			continue;
+
+		bh = sb_bread(inode->i_sb, le32_to_cpu(idx->ei_leaf));
+		if (!bh) {
+			hdd_msg(inode->i_sb, KERN_ERR, "hdd_ext_rm_node",
+				"Read failure, inode=%ld, block=%u",
+				inode->i_ino, le32_to_cpu(idx->ei_leaf));
+			continue;
+		}
+		ceh = (struct hdd_extent_header *) bh->b_data;
+		if (hdd_ext_check_header(inode, ceh, depth - 1)) {
+			brelse(bh);
+			continue;
+		}
+
+		child_dirty = 0;
+		left = hdd_ext_rm_node(inode, ceh, depth - 1, start, end,
+				       child_upper, &child_dirty);
+		if (left == 0) {
+			/* ӽڵѿ, ͷ֮ɾ */
+			unsigned int nr = le32_to_cpu(idx->ei_leaf);
+
+			bforget(bh);
+			hdd_free_blocks(inode, nr, 1);
+			memmove(idx, idx + 1, (char *)(EXT_LAST_INDEX(eh) + 1) -
+				(char *)(idx + 1));
+			le16_add_cpu(&eh->eh_entries, -1);
+			*dirty = 1;
+			continue;
+		}
+
+		if (child_dirty)
+			mark_buffer_dirty_inode(bh, inode);
+		brelse(bh);
+	}
+
+	return le16_to_cpu(eh->eh_entries);
+}
+
+/* ͷ߼ [start, end) еп, ߳ truncate_mutex */
+int hdd_ext_remove_space(struct inode *inode, unsigned int start,
+	unsigned int end)
+{
+	struct hdd_inode_info *hi = HDD_I(inode);
+	struct hdd_ext_path path[HDD_EXT_MAX_DEPTH + 1];
+	struct hdd_extent *ex;
+	struct hdd_extent right;
+	unsigned int ee_block, ee_end;
+	int depth, dirty = 0;
+	int err = 0;
+
+	if (start >= end)
+		return 0;
+
+	down_write(&hi->i_data_sem);
+
+	/* Χλһ extent м, Ҫֳ */
+	err = hdd_ext_find_extent(inode, start, path);
+	if (err)
+		goto out;
+	depth = ext_depth(inode);
+	ex = path[depth].p_ext;
+	if (ex && le32_to_cpu(ex->ee_block) < start && end < ext_end(ex)) {
+		ee_block = le32_to_cpu(ex->ee_block);
+		ee_end = ext_end(ex);
+
+		right.ee_block = cpu_to_le32(end);
+		right.ee_start = cpu_to_le32(le32_to_cpu(ex->ee_start) +
+					     end - ee_block);
+		right.ee_len = cpu_to_le16(ee_end - end);
+		right.ee_flags = ex->ee_flags;
+
+		/* ȲҰ벿, ͷŲԭ, ʧʱ */
+		err = hdd_ext_insert_extent(inode, path, &right);
+		if (err)
+			goto out_path;
+		ex = hdd_ext_refind(inode, path, ee_block, ee_block, &err);
+		if (!ex)
+			goto out_path;
+		hdd_ext_free_blocks(inode, ex, start, end - start);
+		ex->ee_len = cpu_to_le16(start - ee_block);
+		hdd_ext_dirty(inode, path + ext_depth(inode));
+out_path:
+		hdd_ext_drop_path(path);
+		goto out;
+	}
+	hdd_ext_drop_path(path);
+
+	hdd_ext_rm_node(inode, ext_inode_hdr(inode), ext_depth(inode),
+			start, end, HDD_EXT_MAX_BLOCK, &dirty);
+
+	/* ѿ, ָΪ 0 */
+	if (ext_depth(inode) && !ext_inode_hdr(inode)->eh_entries)
+		hdd_ext_tree_init(inode);
+
+	mark_inode_dirty(inode);
+out:
+	up_write(&hi->i_data_sem);
+	return err;
+}
+
+/* һ extent ֮߼, ΪʱΪ 0, ʱΪ HDD_EXT_MAX_BLOCK */
+unsigned int hdd_ext_alloc_end(struct inode *inode)
+{
+	struct hdd_inode_info *hi = HDD_I(inode);
+	struct hdd_ext_path path[HDD_EXT_MAX_DEPTH + 1];
+	struct hdd_extent *ex;
+	unsigned int end = HDD_EXT_MAX_BLOCK;
+
+	down_read(&hi->i_data_sem);
+	if (!hdd_ext_find_extent(inode, HDD_EXT_MAX_BLOCK - 1, path)) {
+		ex = path[ext_depth(inode)].p_ext;
+		end = ex ? ext_end(ex) : 0;
+		hdd_ext_drop_path(path);
+	}
+	up_read(&hi->i_data_sem);
+	return end;
+}
+
+/* ͷ i_size ֮п,  hdd_truncate  */
+void hdd_ext_truncate(struct inode *inode)
+{
+	unsigned int start;
+
+	start = (inode->i_size + inode->i_sb->s_blocksize - 1)
+		>> HDD_BLOCK_LOG_SIZE;
+	hdd_ext_remove_space(inode, start, HDD_EXT_MAX_BLOCK);
+}
@@ -0,0 +1,533 @@
+/*
+ * fmcfs/fmc_hdd/hdd_fext.c
+ *
+ * Copyright (C) 2013 by Xuesen Liang, <liangxuesen@gmail.com>
+ * @ Beijing University of Posts and Telecommunications,
+ * @ CPU & SoC Center of Tsinghua University.
+ *
+ * This program can be redistributed under the terms of the GNU Public License.
+ */
+
+/*
+ * Ŀ extent .
+ *
+ * ÿڴú¼е: һðʼλ,
+ * ڲĿ긽Ŀпͺϲڶ; һð (, ʼλ) ,
+ * ڲҲС N Сж. ڿ״ηʱɿλͼ,
+ * ֮ hdd_new_blocks / hdd_free_blocks ͬά, λͼǴϵ
+ * Ψһ. λͼһ, ڴ治ʱ, , ˻
+ * ɨλͼ, ´ʹʱؽ.
+ *
+ * ȫĿժҪжηּ:  k λͼλĿ, 
+ * ж [2^k, 2^(k+1)) ֮. δĿеĿп
+ * ΪжεϽ. ݴֻȡĿλͼ.
+ */
+
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/rbtree.h>
+#include <linux/buffer_head.h>
+
+#include "hdd.h"
+
+struct hdd_free_extent {
+	struct rb_node	fe_node;	/* ʼλ */
+	struct rb_node	fe_len_node;	/* , ʼλ */
+	unsigned int	fe_start;	/* λ */
+	unsigned int	fe_len;		/*  */
+};
+
+static struct kmem_cache *hdd_fext_cachep;
+
+#define fe_end(fe)	((fe)->fe_start + (fe)->fe_len)
+
+/*  order Ŀλͼ */
+#define fext_summary(sbi, order) \
+	((sbi)->s_group_summary + (order) * (sbi)->s_summary_longs)
+
+static inline struct hdd_group_info *hdd_group_info(struct super_block *sb,
+	unsigned int group)
+{
+	return HDD_SB(sb)->s_group_info + group;
+}
+
+/* 밴ʼλ */
+static void fext_insert_start(struct hdd_group_info *gi,
+	struct hdd_free_extent *new)
+{
+	struct rb_node **p = &gi->gi_root.rb_node;
+	struct rb_node *parent = NULL;
+	struct hdd_free_extent *fe;
+
+	while (*p) {
+		parent = *p;
+		fe = rb_entry(parent, struct hdd_free_extent, fe_node);
+		if (new->fe_start < fe->fe_start)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+	rb_link_node(&new->fe_node, parent, p);
+	rb_insert_color(&new->fe_node, &gi->gi_root);
+}
+
+/* 밴 */
+static void fext_insert_len(struct hdd_group_info *gi,
+	struct hdd_free_extent *new)
+{
+	struct rb_node **p = &gi->gi_len_root.rb_node;
+	struct rb_node *parent = NULL;
+	struct hdd_free_extent *fe;
+
+	while (*p) {
+		parent = *p;
+		fe = rb_entry(parent, struct hdd_free_extent, fe_len_node);
+		if (new->fe_len < fe->fe_len ||
+		    (new->fe_len == fe->fe_len && new->fe_start < fe->fe_start))
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+	rb_link_node(&new->fe_len_node, parent, p);
+	rb_insert_color(&new->fe_len_node, &gi->gi_len_root);
+}
+
+/* ıһεĳ: Ҫڳ */
+static void fext_set_len(struct hdd_group_info *gi,
+	struct hdd_free_extent *fe, unsigned int len)
+{
+	rb_erase(&fe->fe_len_node, &gi->gi_len_root);
+	fe->fe_len = len;
+	fext_insert_len(gi, fe);
+}
+
+/* ɾһ */
+static void fext_erase(struct hdd_group_info *gi, struct hdd_free_extent *fe)
+{
+	rb_erase(&fe->fe_node, &gi->gi_root);
+	rb_erase(&fe->fe_len_node, &gi->gi_len_root);
+	kmem_cache_free(hdd_fext_cachep, fe);
+}
+
+/* мһ */
+static int fext_add(struct hdd_group_info *gi, unsigned int start,
+	unsigned int len)
+{
+	struct hdd_free_extent *fe;
+
+	fe = kmem_cache_alloc(hdd_fext_cachep, GFP_NOFS);
+	if (!fe)
+		return -ENOMEM;
+
+	fe->fe_start = start;
+	fe->fe_len = len;
+	fext_insert_start(gi, fe);
+	fext_insert_len(gi, fe);
+	return 0;
+}
+
+/* Ұ bit Ķ, û, 򷵻 bit ֮ĵһ */
+static struct hdd_free_extent *fext_find(struct hdd_group_info *gi,
+	unsigned int bit)
+{
+	struct rb_node *n = gi->gi_root.rb_node;
+	struct hdd_free_extent *fe, *next = NULL;
+
+	while (n) {
+		fe = rb_entry(n, struct hdd_free_extent, fe_node);
+		if (bit < fe->fe_start) {
+			next = fe;
+			n = n->rb_left;
+		} else if (bit >= fe_end(fe)) {
+			n = n->rb_right;
+		} else {
+			return fe;
+		}
+	}
+	return next;
+}
+
+/*  bit ֮ǰ(ʼλ <= bit)һ */
+static struct hdd_free_extent *fext_find_prev(struct hdd_group_info *gi,
+	unsigned int bit)
+{
+	struct rb_node *n = gi->gi_root.rb_node;
+	struct hdd_free_extent *fe, *prev = NULL;
+
+	while (n) {
+		fe = rb_entry(n, struct hdd_free_extent, fe_node);
+		if (bit < fe->fe_start) {
+			n = n->rb_left;
+		} else {
+			prev = fe;
+			n = n->rb_right;
+		}
+	}
+	return prev;
+}
+
+/* ҳȲС len ̶, ͬʱȡʼλС */
+static struct hdd_free_extent *fext_best_fit(struct hdd_group_info *gi,
+	unsigned int len)
+{
+	struct rb_node *n = gi->gi_len_root.rb_node;
+	struct hdd_free_extent *fe, *best = NULL;
+
+	while (n) {
+		fe = rb_entry(n, struct hdd_free_extent, fe_len_node);
+		if (fe->fe_len >= len) {
+			best = fe;
+			n = n->rb_left;
+		} else {
+			n = n->rb_right;
+		}
+	}
+	return best;
+}
+
+/* , ߳ gi_lock */
+static void fext_unload(struct hdd_group_info *gi)
+{
+	struct rb_node *n;
+	struct hdd_free_extent *fe;
+
+	while ((n = rb_first(&gi->gi_root))) {
+		fe = rb_entry(n, struct hdd_free_extent, fe_node);
+		rb_erase(n, &gi->gi_root);
+		kmem_cache_free(hdd_fext_cachep, fe);
+	}
+	gi->gi_len_root = RB_ROOT;
+	gi->gi_loaded = 0;
+	gi->gi_free = 0;
+}
+
+/* ɿλͼ, ߳ gi_lock */
+static int fext_load(struct super_block *sb, unsigned int group,
+	struct hdd_group_info *gi, struct buffer_head *bitmap_bh)
+{
+	unsigned long *bitmap = (unsigned long *) bitmap_bh->b_data;
+	unsigned int nbits = hdd_group_data_blocks(sb, group);
+	unsigned int bit, next;
+
+	bit = find_next_zero_bit(bitmap, nbits, 0);
+	while (bit < nbits) {
+		next = find_next_bit(bitmap, nbits, bit);
+		if (fext_add(gi, bit, next - bit)) {
+			fext_unload(gi);
+			return -ENOMEM;
+		}
+		gi->gi_free += next - bit;
+		if (next >= nbits)
+			break;
+		bit = find_next_zero_bit(bitmap, nbits, next);
+	}
+	gi->gi_loaded = 1;
+	return 0;
+}
+
+/* Ӷ fe ȡ [bit, bit+len), ߳ gi_lock */
+static void fext_take(struct hdd_group_info *gi, struct hdd_free_extent *fe,
+	unsigned int bit, unsigned int len)
+{
+	unsigned int end = fe_end(fe);
+
+	gi->gi_free -= len;
+	if (bit == fe->fe_start && bit + len == end) {	/*  */
+		fext_erase(gi, fe);
+	} else if (bit == fe->fe_start) {		/* ͷ */
+		fe->fe_start += len;
+		fext_set_len(gi, fe, fe->fe_len - len);
+	} else if (bit + len == end) {			/* β */
+		fext_set_len(gi, fe, fe->fe_len - len);
+	} else {					/* м,  */
+		fext_set_len(gi, fe, bit - fe->fe_start);
+		if (fext_add(gi, bit + len, end - bit - len))
+			fext_unload(gi);
+	}
+}
+
+/* ж¼ڿժҪеļ, ߳ gi_lock */
+static void fext_summarize(struct super_block *sb, unsigned int group,
+	struct hdd_group_info *gi)
+{
+	struct hdd_sb_info *sbi = HDD_SB(sb);
+	struct hdd_group_desc *desc;
+	unsigned int max = 0;
+	int order = -1;
+
+	if (gi->gi_loaded) {
+		if (!RB_EMPTY_ROOT(&gi->gi_len_root))
+			max = rb_entry(rb_last(&gi->gi_len_root),
+				struct hdd_free_extent, fe_len_node)->fe_len;
+	} else {
+		desc = hdd_get_group_desc(sb, group, NULL);
+		if (desc)
+			max = le32_to_cpu(desc->bg_free_blocks_count);
+	}
+
+	if (max)
+		order = min(fls(max) - 1, HDD_FEXT_ORDERS - 1);
+	if (order == gi->gi_order)
+		return;
+
+	if (gi->gi_order >= 0)
+		clear_bit(group, fext_summary(sbi, gi->gi_order));
+	if (order >= 0)
+		set_bit(group, fext_summary(sbi, order));
+	gi->gi_order = order;
+}
+
+/* Ŀ extent ͿժҪ,  hdd_fill_sb  */
+int hdd_fext_init(struct super_block *sb)
+{
+	struct hdd_sb_info *sbi = HDD_SB(sb);
+	unsigned int i;
+
+	sbi->s_group_info = kcalloc(sbi->groups_count,
+				    sizeof(struct hdd_group_info), GFP_KERNEL);
+	if (!sbi->s_group_info)
+		return -ENOMEM;
+
+	sbi->s_summary_longs = BITS_TO_LONGS(sbi->groups_count);
+	sbi->s_group_summary = kcalloc(sbi->s_summary_longs * HDD_FEXT_ORDERS,
+				       sizeof(unsigned long), GFP_KERNEL);
+	if (!sbi->s_group_summary) {
+		kfree(sbi->s_group_info);
+		sbi->s_group_info = NULL;
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < sbi->groups_count; i++) {
+		mutex_init(&sbi->s_group_info[i].gi_lock);
+		sbi->s_group_info[i].gi_root = RB_ROOT;
+		sbi->s_group_info[i].gi_len_root = RB_ROOT;
+		sbi->s_group_info[i].gi_order = -1;
+		fext_summarize(sb, i, &sbi->s_group_info[i]);
+	}
+	return 0;
+}
+
+/* ͷп */
+void hdd_fext_destroy(struct hdd_sb_info *sbi)
+{
+	unsigned int i;
+
+	if (!sbi->s_group_info)
+		return;
+
+	for (i = 0; i < sbi->groups_count; i++)
+		fext_unload(&sbi->s_group_info[i]);
+	kfree(sbi->s_group_info);
+	sbi->s_group_info = NULL;
+	kfree(sbi->s_group_summary);
+	sbi->s_group_summary = NULL;
+}
+
+/* ڿ group  [start, end) з count , ÿλͼ.
+ * best_fit Ϊʱ, Ŀ괦ȡС count ̶, ȡĿ֮׶.
+ * ׸λ, -1 ʾΧûпп,
+ * HDD_FEXT_NOINDEX ʾ, Ҫɨλͼ */
+int hdd_fext_alloc(struct super_block *sb, unsigned int group,
+	struct buffer_head *bitmap_bh, int grp_goal, int start, int end,
+	unsigned long *count, int best_fit)
+{
+	struct hdd_group_info *gi = hdd_group_info(sb, group);
+	struct hdd_free_extent *fe = NULL;
+	unsigned int bit = 0, len = 0, i;
+	int ret = -1;
+
+	mutex_lock(&gi->gi_lock);
+	if (!gi->gi_loaded && fext_load(sb, group, gi, bitmap_bh)) {
+		ret = HDD_FEXT_NOINDEX;
+		goto out;
+	}
+
+	if (grp_goal < start || grp_goal >= end)
+		grp_goal = -1;
+
+	/* 1. Ŀ,  64 пж */
+	if (grp_goal >= 0) {
+		fe = fext_find(gi, grp_goal);
+		if (fe && fe->fe_start <= grp_goal)
+			bit = grp_goal;
+		else if (fe && fe->fe_start < end &&
+			 fe->fe_start - grp_goal < 64)
+			bit = fe->fe_start;
+		else
+			fe = NULL;
+	}
+
+	/* 2. ޶Χʱ, ȡ㹻̶, ûȡ */
+	if (!fe && best_fit) {
+		fe = fext_best_fit(gi, *count);
+		if (!fe && !RB_EMPTY_ROOT(&gi->gi_len_root))
+			fe = rb_entry(rb_last(&gi->gi_len_root),
+				      struct hdd_free_extent, fe_len_node);
+		if (fe && (fe->fe_start < start || fe->fe_start >= end))
+			fe = NULL;
+		if (fe)
+			bit = fe->fe_start;
+	}
+
+	/* 3. Χ(Ԥ)ĵһж */
+	if (!fe) {
+		fe = fext_find(gi, grp_goal >= 0 ? grp_goal : start);
+		if (!fe || fe->fe_start >= end)
+			goto out;
+		bit = max_t(unsigned int, fe->fe_start,
+			    grp_goal >= 0 ? grp_goal : start);
+	}
+
+	len = min_t(unsigned long, *count, fe_end(fe) - bit);
+	len = min_t(unsigned int, len, end - bit);
+
+	/* ÿλͼ; Ϊеλѱ, ˵ѹʱ */
+	for (i = 0; i < len; i++) {
+		if (ext2_set_bit_atomic(sb_bgl_lock(HDD_SB(sb), group),
+					bit + i, bitmap_bh->b_data)) {
+			hdd_msg(sb, KERN_WARNING, __func__,
+				"free extent index out of date, group %u", group);
+			while (i--)
+				ext2_clear_bit_atomic(sb_bgl_lock(HDD_SB(sb),
+					group), bit + i, bitmap_bh->b_data);
+			fext_unload(gi);
+			ret = HDD_FEXT_NOINDEX;
+			goto out;
+		}
+	}
+
+	fext_take(gi, fe, bit, len);
+	ret = bit;
+out:
+	fext_summarize(sb, group, gi);
+	mutex_unlock(&gi->gi_lock);
+	*count = (ret >= 0) ? len : 0;
+	return ret;
+}
+
+/* ҿ bit ׸λ,  -1 ʾû,
+ * HDD_FEXT_NOINDEX ʾδ */
+int hdd_fext_next_free(struct super_block *sb, unsigned int group,
+	unsigned int bit)
+{
+	struct hdd_group_info *gi = hdd_group_info(sb, group);
+	struct hdd_free_extent *fe;
+	int ret = HDD_FEXT_NOINDEX;
+
+	mutex_lock(&gi->gi_lock);
+	if (gi->gi_loaded) {
+		fe = fext_find(gi, bit);
+		if (!fe)
+			ret = -1;
+		else
+			ret = max(fe->fe_start, bit);
+	}
+	mutex_unlock(&gi->gi_lock);
+	return ret;
+}
+
+/* λͼ [bit, bit+count) ѱ, , ڶκϲ */
+void hdd_fext_free(struct super_block *sb, unsigned int group,
+	unsigned int bit, unsigned int count)
+{
+	struct hdd_group_info *gi = hdd_group_info(sb, group);
+	struct hdd_free_extent *prev, *next;
+	struct rb_node *n;
+
+	mutex_lock(&gi->gi_lock);
+	if (!gi->gi_loaded)
+		goto out;
+
+	prev = fext_find_prev(gi, bit);
+	if (prev) {
+		n = rb_next(&prev->fe_node);
+		next = n ? rb_entry(n, struct hdd_free_extent, fe_node) : NULL;
+	} else {
+		n = rb_first(&gi->gi_root);
+		next = n ? rb_entry(n, struct hdd_free_extent, fe_node) : NULL;
+	}
+
+	/* еĿжص, ѹʱ */
+	if ((prev && fe_end(prev) > bit) ||
+	    (next && next->fe_start < bit + count)) {
+		fext_unload(gi);
+		goto out;
+	}
+
+	gi->gi_free += count;
+	if (prev && fe_end(prev) == bit) {
+		if (next && next->fe_start == bit + count) {
+			count += next->fe_len;
+			fext_erase(gi, next);
+		}
+		fext_set_len(gi, prev, prev->fe_len + count);
+	} else if (next && next->fe_start == bit + count) {
+		next->fe_start = bit;
+		fext_set_len(gi, next, next->fe_len + count);
+	} else if (fext_add(gi, bit, count)) {
+		fext_unload(gi);
+	}
+out:
+	fext_summarize(sb, group, gi);
+	mutex_unlock(&gi->gi_lock);
+}
+
+/* еĿпı, ¿ڿժҪеļ */
+void hdd_fext_update(struct super_block *sb, unsigned int group)
+{
+	struct hdd_group_info *gi = hdd_group_info(sb, group);
+
+	mutex_lock(&gi->gi_lock);
+	fext_summarize(sb, group, gi);
+	mutex_unlock(&gi->gi_lock);
+}
+
+/*  start ʼѭжοܲС need ׸,
+ * ؿ, -1 ʾû */
+int hdd_fext_next_group(struct super_block *sb, unsigned int start,
+	unsigned int need)
+{
+	struct hdd_sb_info *sbi = HDD_SB(sb);
+	unsigned int ngroups = sbi->groups_count;
+	unsigned long *bitmap;
+	unsigned int g, dist, best = ngroups;
+	int order, ret = -1;
+
+	if (start >= ngroups)
+		start = 0;
+	order = need ? min(fls(need) - 1, HDD_FEXT_ORDERS - 1) : 0;
+
+	/* ڲĸ, ȡѭ start Ŀ */
+	for (; order < HDD_FEXT_ORDERS; order++) {
+		bitmap = fext_summary(sbi, order);
+		g = find_next_bit(bitmap, ngroups, start);
+		if (g >= ngroups) {	/* Ƶ */
+			g = find_first_bit(bitmap, start);
+			if (g >= start)
+				continue;
+		}
+		dist = (g + ngroups - start) % ngroups;
+		if (dist < best) {
+			best = dist;
+			ret = g;
+		}
+	}
+	return ret;
+}
+
+/*  extent , ģʱ */
+int __init hdd_init_fext_cache(void)
+{
+	hdd_fext_cachep = kmem_cache_create("hdd_free_extent",
+				sizeof(struct hdd_free_extent), 0,
+				SLAB_RECLAIM_ACCOUNT, NULL);
+	if (!hdd_fext_cachep)
+		return -ENOMEM;
+	return 0;
+}
+
+/* ٿ extent  */
+void hdd_destroy_fext_cache(void)
+{
+	kmem_cache_destroy(hdd_fext_cachep);
+}
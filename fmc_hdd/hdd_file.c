@@ -15,21 +15,50 @@
 #include <linux/falloc.h>
 #include <linux/types.h>
 #include <linux/uaccess.h>
+#include <linux/uio.h>
 #include <linux/mount.h>
 #include <linux/time.h>
 
 #include "hdd.h"
 
+/* : ȰλڵĲԤ, ͨö· */
+static ssize_t hdd_file_aio_read(struct kiocb *iocb, const struct iovec *iov,
+	unsigned long nr_segs, loff_t pos)
+{
+	struct file *filp = iocb->ki_filp;
+
+	if (!(filp->f_flags & O_DIRECT))
+		hdd_ra_prepare(filp, pos, iov_length(iov, nr_segs));
+	return generic_file_aio_read(iocb, iov, nr_segs, pos);
+}
+
+/* رһдļʱ, ͷſԤ */
+static int hdd_release_file(struct inode *inode, struct file *filp)
+{
+	struct hdd_inode_info *hi = HDD_I(inode);
+
+	if ((filp->f_mode & FMODE_WRITE) &&
+	    atomic_read(&inode->i_writecount) == 1) {
+		mutex_lock(&hi->truncate_mutex);
+		down_write(&hi->i_data_sem);
+		hdd_discard_reservation(inode);
+		up_write(&hi->i_data_sem);
+		mutex_unlock(&hi->truncate_mutex);
+	}
+	return 0;
+}
+
 const struct file_operations hdd_file_operations = {
 	.llseek		= generic_file_llseek,
 
 	.read		= do_sync_read,
 	.write		= do_sync_write,
 
-	.aio_read	= generic_file_aio_read,
+	.aio_read	= hdd_file_aio_read,
 	.aio_write	= generic_file_aio_write,
 
 	.open		= generic_file_open,
+	.release	= hdd_release_file,
 
 	.mmap		= generic_file_mmap,
 	.fsync		= simple_fsync,
@@ -59,4 +88,5 @@ const struct inode_operations hdd_file_inode_operations = { /* inode.c */
 	.truncate	= hdd_truncate,
 	.getattr	= hdd_getattr,
 	.fiemap		= hdd_fiemap,
+	.fallocate	= hdd_fallocate,
 };
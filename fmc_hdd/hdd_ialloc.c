@@ -297,8 +297,6 @@ got:
 		goto fail;
 	}
 
-	down_read(&sbi->sbi_rwsem);
-
 	percpu_counter_add(&sbi->free_inodes_count, -1);/* ܿ inode  */
 
 	spin_lock(sb_bgl_lock(sbi, group));
@@ -308,12 +306,10 @@ got:
 	}
 	spin_unlock(sb_bgl_lock(sbi, group));
 
-	sb->s_dirt = 1; /* óΪ */
+	hdd_mark_sb_dirty(sb); /* óΪ */
 
 	mark_buffer_dirty(bh2); /* ӦΪ */
 
-	up_read(&sbi->sbi_rwsem);
-
 
 	/* ʼ inode */
 	inode->i_uid = current_fsuid();
@@ -343,6 +339,13 @@ got:
 	hi->i_ssd_blocks = 0;		/*  SSD еĿ */
 	hi->i_direct_bits = 0;		/* ǰ12λñ־ */
 	memset(hi->i_direct_blks, 0, HDD_NDIR_BLOCKS); /* ǰ12ķʼ */
+	hi->i_heat_epoch = HDD_SB(sb)->s_heat_epoch;	/* ʼļԪ */
+
+	/* ʱָ extents, ³ļʹ extent  */
+	if (S_ISREG(mode) && test_opt(sb, EXTENTS)) {
+		hi->i_flags |= HDD_EXTENTS_FL;
+		hdd_ext_tree_init(inode);
+	}
 
 	hdd_set_inode_flags(inode);
 	inode->i_generation = 0;
@@ -385,8 +388,6 @@ static void hdd_release_inode(struct super_block *sb, int group, int dir)
 		return;
 	}
 
-	down_read(&HDD_SB(sb)->sbi_rwsem);
-
 	spin_lock(sb_bgl_lock(HDD_SB(sb), group));
 	le32_add_cpu(&desc->bg_free_inodes_count, 1);
 	if (dir)
@@ -394,9 +395,7 @@ static void hdd_release_inode(struct super_block *sb, int group, int dir)
 	spin_unlock(sb_bgl_lock(HDD_SB(sb), group));
 
 	percpu_counter_inc(&HDD_SB(sb)->free_inodes_count); /*  inode  */
-	sb->s_dirt = HDD_SB(sb)->s_dirty = 1;
-
-	up_read(&HDD_SB(sb)->sbi_rwsem);
+	hdd_mark_sb_dirty(sb);
 
 	mark_buffer_dirty(bh);
 }
@@ -18,10 +18,23 @@
 #include <linux/buffer_head.h>
 #include <linux/mpage.h>
 #include <linux/fiemap.h>
+#include <linux/falloc.h>
 #include <linux/namei.h>
+#include <linux/pagevec.h>
+#include <linux/kthread.h>
+#include <linux/slab.h>
+#include <linux/uio.h>
 
 #include "hdd.h"
 
+#define HDD_IND_READAHEAD	8	/* ַ߽ʱԤֵַܵ */
+#define HDD_RECLAIM_MIN_BLOCKS	4096	/* ڴ˿ļں̨ͷ */
+#define HDD_RECLAIM_BATCH	(HDD_ADDR_PER_BLOCK * 64)/* ̨ÿͷŵĿ */
+
+#ifndef FALLOC_FL_PUNCH_HOLE
+#define FALLOC_FL_PUNCH_HOLE	0x02	/* ͷŷΧڵĿ,  KEEP_SIZE ͬ */
+#endif
+
 typedef struct _inderect {
 	__le32	*p;		/* ָһ */
 	__le32	key;		/* ָĿֵ */
@@ -29,9 +42,11 @@ typedef struct _inderect {
 } Indirect;
 
 int hdd_sync_inode(struct inode *inode);
+static void hdd_pending_add(struct inode *inode);
 
 void access_info_init(struct inode *inode,struct buffer_head *bh, unsigned int offset);
-int access_info_inc(struct inode * inode, Indirect *branch, unsigned int offset);
+int access_info_inc(struct inode * inode, Indirect *branch, unsigned int offset,
+	unsigned int gen);
 void access_info_sub(struct inode *inode, __le32 *data, int offset, int count);
 
 /* Ӵ̶ȡ inode ṹ */
@@ -155,8 +170,10 @@ struct inode *hdd_iget (struct super_block *sb, unsigned long ino)
 
 	hi->i_dtime = le32_to_cpu(raw_inode->i_dtime);
 
-	if (inode->i_nlink == 0 && (inode->i_mode == 0 || hi->i_dtime)) {
-		/*  inode ѱɾ */
+	hi->i_flags = le32_to_cpu(raw_inode->i_flags);
+	if (inode->i_nlink == 0 && (inode->i_mode == 0 || hi->i_dtime)
+	&& !(hi->i_flags & HDD_PENDING_FREE_FL)) {
+		/*  inode ѱɾ; ̨ͷŵ inode Կɶȡ */
 		brelse (bh);
 		ret = -ESTALE;
 		goto bad_inode;
@@ -164,9 +181,9 @@ struct inode *hdd_iget (struct super_block *sb, unsigned long ino)
 
 	for (n = 0; n < HDD_N_BLOCKS; n++)
 		hi->i_data[n] = raw_inode->u.s_hdd.i_block[n];
-	hi->i_flags = le32_to_cpu(raw_inode->i_flags);
 	hi->i_state = 0;
-	hi->i_dtime = 0;
+	if (!(hi->i_flags & HDD_PENDING_FREE_FL))
+		hi->i_dtime = 0;	/* Ϊͷеһ inode  */
 	hi->i_block_group = ino / sbi->inodes_per_group;
 	hi->i_dir_start_lookup = 0;
 	hi->i_access_count = le32_to_cpu(raw_inode->i_access_count);
@@ -174,11 +191,19 @@ struct inode *hdd_iget (struct super_block *sb, unsigned long ino)
 	hi->i_direct_bits = raw_inode->u.s_hdd.i_direct_bits;/* ǰ12ı־ */
 	for (n = 0; n < HDD_NDIR_BLOCKS; ++n)/* ǰ12ķʼ */
 		hi->i_direct_blks[n] = raw_inode->u.s_hdd.i_direct_blks[n];
+	hi->i_heat_epoch = le16_to_cpu(raw_inode->u.s_hdd.i_heat_epoch);
+
+	/* extent ĸڵϷ */
+	if ((hi->i_flags & HDD_EXTENTS_FL) && hdd_ext_check_inode(inode)) {
+		brelse (bh);
+		ret = -EIO;
+		goto bad_inode;
+	}
 
 	/*  i_op, i_fop, i_mapping  */
 	if (S_ISREG(inode->i_mode)) {
 		inode->i_op = &hdd_file_inode_operations;
-		inode->i_mapping->a_ops = &hdd_aops;
+		hdd_set_aops(inode);
 		inode->i_fop = &hdd_file_operations;
 	} else if (S_ISDIR(inode->i_mode)) {
 		inode->i_op = &hdd_dir_inode_operations;
@@ -249,6 +274,7 @@ int hdd_write_inode(struct inode *inode, int do_sync)
 	raw->u.s_hdd.i_direct_bits = hi->i_direct_bits;/* ǰ12ı־ */
 	for (n = 0; n < HDD_NDIR_BLOCKS; ++n)/* ǰ12ķʼ */
 		raw->u.s_hdd.i_direct_blks[n] = hi->i_direct_blks[n];
+	raw->u.s_hdd.i_heat_epoch = cpu_to_le16(hi->i_heat_epoch);
 
 	if (S_ISCHR(inode->i_mode) || S_ISBLK(inode->i_mode)) {
 		raw->u.s_hdd.i_block[0] = 0;
@@ -314,8 +340,8 @@ static int hdd_block_to_path(struct inode *inode,
 			"hdd_block_to_path", "block > big");
 	}
 
-	if(n >= 2) /* ӵַһҪƫ */
-		offsets[n-1] += HDD_ACCESS_END;
+	if(n >= 2) /* ӵַһҪƫ(ԵַΪλ) */
+		offsets[n-1] += HDD_ADDR_START;
 
 	if (boundary)
 		/* λһַһַʱ, ֵ 0,  > 0 */
@@ -339,13 +365,144 @@ static inline int verify_chain(Indirect *from, Indirect *to)
 	return (from > to);
 }
 
-/* · offset, õʵʵַ· chain */
+/* ֤·: Ƚڼд޸ĵַʱ,
+ * д(֧, ضժ·֧) i_meta_seq д */
+static inline int verify_chain_seq(struct inode *inode,
+	Indirect *from, Indirect *to)
+{
+	seqlock_t *sl = &HDD_I(inode)->i_meta_seq;
+	unsigned seq;
+	int ok;
+
+	do {
+		seq = read_seqbegin(sl);
+		ok = verify_chain(from, to);
+	} while (read_seqretry(sl, seq));
+	return ok;
+}
+
+/* λλͼȡõַ offset ָݿλ: BLOCK_ON_SSD/BLOCK_ON_HDD */
+static inline int hdd_block_location(struct inode *inode,
+	Indirect *branch, unsigned int offset)
+{
+	/* branch->bh Ϊ NULL, ʾ offset Ϊֱӿƫ, Ϊһеƫ */
+	if (!branch->bh)
+		return (HDD_I(inode)->i_direct_bits & (1 << offset)) ?
+			BLOCK_ON_SSD : BLOCK_ON_HDD;
+
+	return ext2_test_bit(offset - HDD_ADDR_START, branch->bh->b_data) ?
+		BLOCK_ON_SSD : BLOCK_ON_HDD;
+}
+
+/* ַ offset ָݿķֽ, bh Ϊ NULL ʱ offset Ϊֱӿƫ */
+static inline __u8 *hdd_access_byte(struct inode *inode,
+	struct buffer_head *bh, unsigned int offset)
+{
+	if (!bh)
+		return &HDD_I(inode)->i_direct_blks[offset];
+
+	return (__u8 *) bh->b_data + HDD_ADDR_BMAP_END + offset - HDD_ADDR_START;
+}
+
+/* ӳ仺ʱȶ:  sketch ʱȡֵ, ȡʼ;
+ * ַ鲻ڴʱΪ˶豸,  0  */
+static unsigned int hdd_cached_heat(struct inode *inode, sector_t iblock,
+	struct hdd_access_rec *rec)
+{
+	struct buffer_head *bh;
+	unsigned int heat = hdd_sketch_add(inode, iblock);
+
+	if (HDD_SB(inode->i_sb)->s_sketch)
+		return heat;
+
+	if (!rec->ablk) {
+		heat = *hdd_access_byte(inode, NULL, rec->aidx);
+	} else {
+		bh = sb_find_get_block(inode->i_sb, rec->ablk);
+		if (!bh)
+			return 0;
+		if (buffer_uptodate(bh))
+			heat = *hdd_access_byte(inode, bh, rec->aidx);
+		brelse(bh);
+	}
+	return heat == HDD_ACCESS_UNWRITTEN ? 0 : heat;
+}
+
+/* ֽڵļԪ; data Ϊַ,  i_data ʱΪֱӿ */
+static inline unsigned int hdd_heat_stamp(struct inode *inode, void *data)
+{
+	if (data == HDD_I(inode)->i_data)
+		return HDD_I(inode)->i_heat_epoch;
+
+	return le16_to_cpu(*(__le16 *) ((char *) data + HDD_ADDR_EPOCH));
+}
+
+/* ԪΪ stamp ķֽڵǰԪӦƵλ, ߳ s_heat_sem */
+static inline unsigned int hdd_heat_shift(struct inode *inode,
+	unsigned int stamp)
+{
+	struct hdd_sb_info *sbi = HDD_SB(inode->i_sb);
+	__u16 age = (__u16) (sbi->s_heat_epoch - stamp);
+
+	if (!sbi->s_heat_period)
+		return 0;
+	return min_t(unsigned int, age, HDD_HEAT_MAX_SHIFT);
+}
+
+/* ַ offset ָݿǷΪ fallocate Ԥ, δдĿ */
+static inline int hdd_block_unwritten(struct inode *inode,
+	Indirect *branch, unsigned int offset)
+{
+	return *hdd_access_byte(inode, branch->bh, offset) ==
+		HDD_ACCESS_UNWRITTEN;
+}
+
+/*  parent ֵַַָ֮ܵ鷢첽,
+ * ˳Խǰһʱͬȡһַ.
+ * parent  i_data ʱһμַ,  i_data Ƕ, μַ
+ * ĸֵ; һһַǶμַĵһӿ, 
+ * ַڴʱԤӿ, Ԥ */
+static void hdd_readahead_siblings(struct inode *inode, Indirect *parent)
+{
+	struct super_block *sb = inode->i_sb;
+	struct buffer_head *bh = NULL;
+	__le32 *p, *end;
+	unsigned int key;
+	int i;
+
+	if (parent->bh) {
+		p = parent->p + 1;
+		end = (__le32 *) parent->bh->b_data + 1024;
+	} else {
+		key = le32_to_cpu(HDD_I(inode)->i_data[HDD_DIND_BLOCK]);
+		if (!key)
+			return;
+		bh = sb_find_get_block(sb, key);
+		if (!bh || !buffer_uptodate(bh)) {
+			brelse(bh);
+			sb_breadahead(sb, key);
+			return;
+		}
+		p = (__le32 *) bh->b_data;
+		end = p + 1024;
+	}
+
+	for (i = 0; i < HDD_IND_READAHEAD && p < end; i++, p++)
+		if (*p)
+			sb_breadahead(sb, le32_to_cpu(*p));
+	brelse(bh);
+}
+
+/* · offset, õʵʵַ· chain;
+ * nowait ʱֻʹڴеĵַ, 򷵻 -EAGAIN, 豸 */
 static Indirect * hdd_get_branch(struct inode *inode,
-	int depth, int *offsets, Indirect *chain, int *err)
+	int depth, int *offsets, Indirect *chain, int *err, int nowait)
 {
 	struct super_block *sb = inode->i_sb;
 	struct buffer_head *bh;
 	Indirect *p = chain;
+	unsigned seq;
+	int changed;
 
 	*err = 0;
 
@@ -354,27 +511,40 @@ static Indirect * hdd_get_branch(struct inode *inode,
 		return p;
 
 	while (--depth) {
-		bh = sb_bread(sb, le32_to_cpu(p->key)); /* ȡԪݿ */
-		if (!bh) {
-			*err = -EIO;
-			return p;
+		if (nowait) {
+			bh = sb_find_get_block(sb, le32_to_cpu(p->key));
+			if (!bh || !buffer_uptodate(bh)) {
+				brelse(bh);
+				*err = -EAGAIN;
+				return p;
+			}
+		} else {
+			bh = sb_bread(sb, le32_to_cpu(p->key)); /* ȡԪݿ */
+			if (!bh) {
+				*err = -EIO;
+				return p;
+			}
 		}
 
-		read_lock(&HDD_I(inode)->i_meta_lock);
-		if (!verify_chain(chain, p))
-			goto diff;//changed;
-
-		add_chain (++p, bh, (__le32*)bh->b_data + *++offsets);
-
-		read_unlock(&HDD_I(inode)->i_meta_lock);
-
+		/* ·¶ĵַͬһȡ */
+		do {
+			seq = read_seqbegin(&HDD_I(inode)->i_meta_seq);
+			changed = !verify_chain(chain, p);
+			if (!changed)
+				add_chain(p + 1, bh,
+					  (__le32*)bh->b_data + offsets[1]);
+		} while (read_seqretry(&HDD_I(inode)->i_meta_seq, seq));
+		if (changed)
+			goto diff;
+
+		p++;
+		offsets++;
 		if (!p->key)
 			return p;
 	}
 	return NULL;
 
 diff:
-	read_unlock(&HDD_I(inode)->i_meta_lock);
 	brelse(bh);
 	*err = -EAGAIN;
 	return p;
@@ -390,12 +560,18 @@ static unsigned int hdd_find_goal(struct inode *inode,
 	*/
 	struct hdd_inode_info *hi = HDD_I(inode);
 	struct hdd_sb_info *sbi = HDD_SB(inode->i_sb);
+	struct hdd_block_alloc_info *block_i = hi->i_block_alloc_info;
 	Indirect *ind = partial;
 	__le32 *start = NULL;
 	__le32 *p = NULL;
 	unsigned int bg_start = 0;
 	unsigned int colour = 0;
 
+	/* ˳׷ʱ, ϴηĿ֮ */
+	if (block_i && block == block_i->last_alloc_logical_block + 1
+	&& block_i->last_alloc_physical_block != 0)
+		return block_i->last_alloc_physical_block + 1;
+
 	if (!ind->bh) /* ûȡ, Ϊֱӿ */
 		start = hi->i_data;
 	else {
@@ -451,7 +627,7 @@ static int hdd_blks_to_allocate(Indirect * branch, int ind_blks,
 /* ӿֱӿ */
 static int hdd_alloc_blocks(struct inode *inode,
 	unsigned int goal, int indirect_blks, int blks,
-	unsigned int new_blocks[4], int *err)
+	unsigned int new_blocks[4], int delalloc, int *err)
 {
 /* @indirect_blks: Ҫļӿ
  * @new_blocks: ļӿֱӿ¿
@@ -470,7 +646,7 @@ static int hdd_alloc_blocks(struct inode *inode,
 	while (1) {
 		count = target;
 		/* count Ŀ, ʼ */
-		current_block = hdd_new_blocks(inode,goal,&count,err);
+		current_block = hdd_new_blocks(inode, goal, &count, delalloc, err);
 		if (*err)
 			goto failed_out;
 
@@ -499,26 +675,27 @@ failed_out:
 
 /* ʵ·з, , λ bit, ʼ */
 static int hdd_alloc_branch(struct inode *inode, int indirect_blks,
-	int *blks, unsigned int goal, int *offsets, Indirect *branch)
+	int *blks, unsigned int goal, int *offsets, Indirect *branch,
+	int unwritten, int delalloc)
 {
+/* @unwritten: ݿΪδд, Ϊ
+ * @delalloc: Ϊӳٿд, ʹԤĿ */
 	int i, n = 0;
 	int err = 0;
 	int num = 0;
 	unsigned int  new_blocks[4] = {0};
 	unsigned int  current_block = 0;
 	struct buffer_head *bh = NULL;
-	unsigned int  addr_offset[4] = {0};
 	//unsigned int from_direct = 0;
 	int blocksize = inode->i_sb->s_blocksize;
 	struct hdd_sb_info *sbi = HDD_SB(inode->i_sb);
 
 	/* ӿֱӿ, ֱӿ */
 	num = hdd_alloc_blocks(inode, goal, indirect_blks,
-				*blks, new_blocks, &err);
+				*blks, new_blocks, delalloc, &err);
 	if (err)
 		return err;
 
-	addr_offset[indirect_blks] = HDD_ACCESS_END;/* һƫ */
 	branch[0].key = cpu_to_le32(new_blocks[0]); /* ·ĵһ */
 
 	/* ȼ¼ӿ */
@@ -528,8 +705,8 @@ static int hdd_alloc_branch(struct inode *inode, int indirect_blks,
 
 		lock_buffer(bh);
 		memset(bh->b_data, 0, blocksize); /* ¸ */
-		branch[n].p = (__le32 *) (bh->b_data + addr_offset[n])
-			+ offsets[n]; /* ڸڵĵַ */
+		/* ڸڵĵַ, һ offsets Ѻַƫ */
+		branch[n].p = (__le32 *) bh->b_data + offsets[n];
 		branch[n].key = cpu_to_le32(new_blocks[n]);/*  */
 		*branch[n].p = branch[n].key;/* ѿд븸 */
 
@@ -544,6 +721,9 @@ static int hdd_alloc_branch(struct inode *inode, int indirect_blks,
 				access_info_init(inode, bh, offsets[n] + i);
 				*(branch[n].p + i) = cpu_to_le32(++current_block);
 			}
+			for (i = 0; unwritten && i < num; i++)
+				*hdd_access_byte(inode, bh, offsets[n] + i) =
+					HDD_ACCESS_UNWRITTEN;
 		}
 
 		set_buffer_uptodate(bh);
@@ -553,28 +733,37 @@ static int hdd_alloc_branch(struct inode *inode, int indirect_blks,
 			sync_dirty_buffer(bh);
 	}
 
-	if (indirect_blks == 0) { /* ֻݿ */
-		*branch[0].p = branch[0].key; /* ¼ַ */
-		if (NULL == branch[0].bh )/* ݿֱӿָ */
-			access_info_init(inode, NULL, offsets[0]);
-		else { /* ݿɼӿָ */
-			lock_buffer(branch[0].bh);
-			/* ¿ķʼ */
-			access_info_init(inode, branch[0].bh, offsets[0]);
+	bh = branch[0].bh; /* Ѵڵĸ, Ϊ NULL ʱʾַ */
+	if (bh)
+		lock_buffer(bh);
 
-			set_buffer_uptodate(bh);
-			unlock_buffer(bh);
-			mark_buffer_dirty_inode(bh, inode);
-			if (S_ISDIR(inode->i_mode) && IS_DIRSYNC(inode))
-				sync_dirty_buffer(bh);
+	if (indirect_blks == 0) { /* ֻݿ, ¿ķʼ */
+		current_block = new_blocks[0];
+		access_info_init(inode, bh, offsets[0]);
+		for (i = 1; i < num; i++) {
+			access_info_init(inode, bh, offsets[0] + i);
+			*(branch[0].p + i) = cpu_to_le32(++current_block);
 		}
+		for (i = 0; unwritten && i < num; i++)
+			*hdd_access_byte(inode, bh, offsets[0] + i) =
+				HDD_ACCESS_UNWRITTEN;
+	}
+
+	/* ·֧Ѵڵĸ, ֮ǰ߿Ʒķ֧ */
+	write_seqlock(&HDD_I(inode)->i_meta_seq);
+	*branch[0].p = branch[0].key;
+	write_sequnlock(&HDD_I(inode)->i_meta_seq);
+
+	if (bh) { /* ݿɼӿָ */
+		unlock_buffer(bh);
+		mark_buffer_dirty_inode(bh, inode);
+		if (S_ISDIR(inode->i_mode) && IS_DIRSYNC(inode))
+			sync_dirty_buffer(bh);
 	}
 
 	*blks = num;
 
-	down_read(&sbi->sbi_rwsem);
-	percpu_counter_inc(&sbi->usr_blocks); /* ûݵĿ */
-	up_read(&sbi->sbi_rwsem);
+	percpu_counter_add(&sbi->usr_blocks, num); /* ûݵĿ */
 
 	inode->i_ctime = CURRENT_TIME_SEC;
 	mark_inode_dirty(inode);	/*  inode  */
@@ -582,6 +771,115 @@ static int hdd_alloc_branch(struct inode *inode, int indirect_blks,
 	return err;
 }
 
+/* Ϊ n ·,  k ַָǵĿ */
+static long hdd_subtree_blocks(int n, int k)
+{
+	long span = 1;
+
+	for (k++; k < n; k++)
+		span *= (k == n - 1) ? HDD_ADDR_PER_BLOCK : 1024;
+	return span;
+}
+
+/* iblock ڵ k ַָе */
+static long hdd_subtree_index(int n, int k, int offsets[4])
+{
+	long idx = 0;
+	int j;
+
+	for (j = k + 1; j < n; j++) {
+		idx *= (j == n - 1) ? HDD_ADDR_PER_BLOCK : 1024;
+		idx += offsets[j] - ((j == n - 1) ? HDD_ADDR_START : 0);
+	}
+	return idx;
+}
+
+/* ļ߼鷶Χ [r_start, r_end) ,  hi->i_ranges  */
+struct hdd_range {
+	struct list_head	r_list;
+	long			r_start;
+	long			r_end;
+};
+
+#define HDD_RANGE_ALL	LONG_MAX	/* סļʱķΧյ */
+
+/*  [start, end) ǷѼķΧཻ, ߳ i_range_lock */
+static int hdd_range_busy(struct hdd_inode_info *hi, long start, long end)
+{
+	struct hdd_range *r;
+
+	list_for_each_entry(r, &hi->i_ranges, r_list)
+		if (r->r_start < end && start < r->r_end)
+			return 1;
+	return 0;
+}
+
+/* ס߼鷶Χ [start, end), ཻ֮ķΧǰһֱȴ */
+static void hdd_range_lock(struct inode *inode, struct hdd_range *range,
+	long start, long end)
+{
+	struct hdd_inode_info *hi = HDD_I(inode);
+	DEFINE_WAIT(wait);
+
+	range->r_start = start;
+	range->r_end = end;
+
+	spin_lock(&hi->i_range_lock);
+	while (hdd_range_busy(hi, start, end)) {
+		prepare_to_wait(&hi->i_range_wait, &wait, TASK_UNINTERRUPTIBLE);
+		spin_unlock(&hi->i_range_lock);
+		schedule();
+		spin_lock(&hi->i_range_lock);
+	}
+	finish_wait(&hi->i_range_wait, &wait);
+	list_add(&range->r_list, &hi->i_ranges);
+	spin_unlock(&hi->i_range_lock);
+}
+
+static void hdd_range_unlock(struct inode *inode, struct hdd_range *range)
+{
+	struct hdd_inode_info *hi = HDD_I(inode);
+
+	spin_lock(&hi->i_range_lock);
+	list_del(&range->r_list);
+	spin_unlock(&hi->i_range_lock);
+	wake_up_all(&hi->i_range_wait);
+}
+
+/* ڵ k ַʱҪס߼鷶Χ:
+ * ½ַʱסõַָ, ֻҪݿ;
+ * ֱӿ鹲 inode еλñ־,  */
+static void hdd_alloc_range(int depth, int k, int offsets[4], long iblock,
+	unsigned long maxblocks, int blocks_to_boundary,
+	long *start, long *end)
+{
+	if (depth == 1) {
+		*start = 0;
+		*end = HDD_NDIR_BLOCKS;
+	} else if (k == depth - 1) {
+		*start = iblock;
+		*end = iblock + min_t(unsigned long, maxblocks,
+				      blocks_to_boundary + 1);
+	} else {
+		*start = iblock - hdd_subtree_index(depth, k, offsets);
+		*end = *start + hdd_subtree_blocks(depth, k);
+	}
+}
+
+/*  bh ӳ䵽 location ʾ豸ϵĿ blocknr */
+static void hdd_map_bh(struct inode *inode, struct buffer_head *bh,
+	int location, unsigned int blocknr)
+{
+	if (location == BLOCK_ON_SSD) {
+		set_buffer_mapped(bh);
+		bh->b_bdev = HDD_SB(inode->i_sb)->ssd_bdev;
+		bh->b_blocknr = blocknr;
+		bh->b_size = inode->i_sb->s_blocksize;
+	} else {/* δǨ */
+		map_bh(bh, inode->i_sb, blocknr);
+	}
+}
+
 /* ȡļԿ iblock ʵʿ, ¼ bh_result , ֮ */
 static int hdd_get_blocks(struct inode *inode,
 	sector_t iblock, unsigned long maxblocks,
@@ -597,8 +895,52 @@ static int hdd_get_blocks(struct inode *inode,
 	int count = 0;			/* ¼ֱӿ */
 	int blocks_to_boundary = 0;	/* һӿβĵַ */
 	int location = 0;		/* λ: 1-SSD, 0-HDD */
+	int mapped = 0;			/* ǷΪѷĲ */
+	int unwritten = 0;		/* ѷǷδд */
+	int i;
+	int extend;			/* ܷһ */
+	unsigned seq;
+	long start, end;		/* ʱ߼鷶Χ */
+	struct hdd_range range;
+	unsigned int pblk, len;		/* ӳ仺е, ʣ */
+	int boundary;			/* βǷΪһĽβ */
+	unsigned int gen;		/* ӳ仺 */
+	struct hdd_access_rec rec;	/* ӳ仺ʱ¼ķ */
+	unsigned int heat = 0;		/* ȶ, ڽж */
+	Indirect *last = NULL;		/* һ */
 	struct hdd_inode_info *hi = HDD_I(inode);
-	struct hdd_sb_info *sbi = HDD_SB(inode->i_sb);
+	int nowait = create & HDD_GET_BLOCKS_NOWAIT;
+	int delalloc = create & HDD_GET_BLOCKS_DELALLOC;
+	int noacct = create & HDD_GET_BLOCKS_NOACCT;
+
+	create &= ~(HDD_GET_BLOCKS_NOWAIT | HDD_GET_BLOCKS_DELALLOC |
+		    HDD_GET_BLOCKS_NOACCT);
+	BUG_ON(nowait && create);	/* ʱҪַ */
+
+	/* ʹ extent ļ;  extent ʱܶ豸 */
+	if (hi->i_flags & HDD_EXTENTS_FL) {
+		if (nowait)
+			return -EAGAIN;
+		return hdd_ext_get_blocks(inode, iblock, maxblocks,
+					  bh_result, create | delalloc);
+	}
+
+	/* ӳ仺, ضȡַ */
+	if (hdd_map_cache_lookup(inode, iblock, &pblk, &len,
+				 &location, &boundary, &rec)) {
+		if (!noacct)
+			hdd_access_note(inode, &rec);
+		count = min_t(unsigned long, len, maxblocks);
+		if (!nowait && !noacct)
+			hdd_promote_admit(inode, iblock, count, location,
+				hdd_cached_heat(inode, iblock, &rec));
+		clear_buffer_new(bh_result);
+		hdd_map_bh(inode, bh_result, location, pblk);
+		if (location == BLOCK_ON_HDD && boundary && count == len)
+			set_buffer_boundary(bh_result);
+		return count;
+	}
+	gen = hdd_map_cache_gen(inode);	/* ڽ·֮ǰȡ */
 
 	/* ݿļеλ,ҵͨ·- */
 	depth = hdd_block_to_path(inode, iblock,
@@ -607,13 +949,14 @@ static int hdd_get_blocks(struct inode *inode,
 		return (err);
 
 	/* ·, õݿʵ· */
-	partial = hdd_get_branch(inode, depth, offsets, chain, &err);
+	partial = hdd_get_branch(inode, depth, offsets, chain, &err, nowait);
 
 	/* Ҫݿ */
 	if (!partial) {
 		/*  buffer µ, Ҫ豸ȡ */
 		clear_buffer_new (bh_result);
 		count++;
+		mapped = 1;
 		if (err != -EAGAIN)
 			goto got_it;  /*  */
 	}
@@ -622,22 +965,55 @@ static int hdd_get_blocks(struct inode *inode,
 	if (!create || err == -EIO)/* ¿, ߶ȡʧ */
 		goto cleanup;
 
-	mutex_lock(&hi->truncate_mutex);
-	if (err == -EAGAIN || !verify_chain(chain, partial)) {
+	/* ļ״ηʱԤϢ */
+	if (S_ISREG(inode->i_mode) && !hi->i_block_alloc_info) {
+		mutex_lock(&hi->truncate_mutex);
+		if (!hi->i_block_alloc_info)
+			hdd_init_block_alloc_info(inode);
+		mutex_unlock(&hi->truncate_mutex);
+	}
+
+	/* ֻסҪ޸ĵ, ͬед߿ɲз;
+	   ضϺʹסļ */
+	hdd_alloc_range(depth, partial ? partial - chain : depth - 1, offsets,
+			iblock, maxblocks, blocks_to_boundary, &start, &end);
+relock:
+	hdd_range_lock(inode, &range, start, end);
+
+	if (err == -EAGAIN || !verify_chain_seq(inode, chain, partial)) {
+		long new_start, new_end;
+
 		while (partial > chain) {
 			brelse(partial->bh);
 			partial--;
 		}
 		/* ·, õʵ· */
-		partial = hdd_get_branch(inode, depth, offsets, chain, &err);
+		partial = hdd_get_branch(inode, depth, offsets, chain, &err, 0);
 		if (!partial) {
 			count++;
-			mutex_unlock(&hi->truncate_mutex);
+			hdd_range_unlock(inode, &range);
 			if (err)
 				goto cleanup;
 			clear_buffer_new(bh_result);
+			mapped = 1;
 			goto got_it; /*  */
 		}
+		if (err) {
+			hdd_range_unlock(inode, &range);
+			goto cleanup;
+		}
+
+		/* ǰ·ض, Ҫ޸ĵסĴ, ¼ */
+		hdd_alloc_range(depth, partial - chain, offsets, iblock,
+				maxblocks, blocks_to_boundary,
+				&new_start, &new_end);
+		if (new_start < start || new_end > end) {
+			hdd_range_unlock(inode, &range);
+			start = new_start;
+			end = new_end;
+			err = -EAGAIN;
+			goto relock;
+		}
 	}
 
 	/* Ҫ */
@@ -652,8 +1028,15 @@ static int hdd_get_blocks(struct inode *inode,
 				maxblocks, blocks_to_boundary);
 	/* ʵ·з */
 	err = hdd_alloc_branch(inode, indirect_blks, &count, goal,
-				offsets + (partial - chain), partial);
-	mutex_unlock(&hi->truncate_mutex);
+				offsets + (partial - chain), partial,
+				create == HDD_GET_BLOCKS_PREALLOC, delalloc);
+	if (!err && hi->i_block_alloc_info) { /* ¼ηλ */
+		hi->i_block_alloc_info->last_alloc_logical_block =
+			iblock + count - 1;
+		hi->i_block_alloc_info->last_alloc_physical_block =
+			le32_to_cpu(chain[depth-1].key) + count - 1;
+	}
+	hdd_range_unlock(inode, &range);
 
 	if (err) 
 		goto cleanup;
@@ -661,24 +1044,96 @@ static int hdd_get_blocks(struct inode *inode,
 	set_buffer_new(bh_result);
 got_it:
 	/*  inode еĵַԿ, ·ʼ, λ:SSD/HDD */
-	location = access_info_inc(inode, chain+depth-1, offsets[depth-1]);
+	last = chain + depth - 1;
+	if (noacct)
+		location = hdd_block_location(inode, last, offsets[depth-1]);
+	else
+		location = access_info_inc(inode, last, offsets[depth-1], gen);
+	if (mapped)
+		unwritten = hdd_block_unwritten(inode, last, offsets[depth-1]);
+
+	/* ȶ:  sketch ʱȡֵ, ȡдַķʼ */
+	if (mapped && !nowait && !noacct) {
+		heat = hdd_sketch_add(inode, iblock);
+		if (!HDD_SB(inode->i_sb)->s_sketch && !unwritten)
+			heat = *hdd_access_byte(inode, last->bh, offsets[depth-1]);
+	}
 
-	/* ʵλ, ɼ¼ [豸+ʵʿ]  bh_result  */
-	if(location == BLOCK_ON_SSD) {
-		set_buffer_mapped(bh_result);
-		bh_result->b_bdev = sbi->ssd_bdev;
-		bh_result->b_blocknr = le32_to_cpu(chain[depth-1].key);
-		bh_result->b_size = inode->i_sb->s_blocksize;
-	} else {/* δǨ */
-		map_bh(bh_result, inode->i_sb, le32_to_cpu(chain[depth-1].key));
+	/* ѷ: 쵽ͬһ豸һ,
+	   ԽһĽβ, ҲԽλλͼ SSD/HDD ı仯 */
+	while (mapped && count < maxblocks && count <= blocks_to_boundary) {
+		do {
+			seq = read_seqbegin(&hi->i_meta_seq);
+			extend = verify_chain(chain, last)
+			&& le32_to_cpu(*(last->p + count)) ==
+			   le32_to_cpu(last->key) + count
+			&& hdd_block_location(inode, last,
+				offsets[depth-1] + count) == location
+			&& hdd_block_unwritten(inode, last,
+				offsets[depth-1] + count) == unwritten;
+		} while (read_seqretry(&hi->i_meta_seq, seq));
+		if (!extend)
+			break;
+		count++;
 	}
 
+	/* δд: ʱն, Ϊ,  bh_result Ϊδд;
+	   дʱδд־ */
+	if (unwritten && !create) {
+		set_buffer_unwritten(bh_result);
+		err = 0;
+		partial = last;
+		goto cleanup;
+	}
+	if (unwritten && create != HDD_GET_BLOCKS_PREALLOC) {
+		hdd_alloc_range(depth, depth - 1, offsets, iblock, count,
+				blocks_to_boundary, &start, &end);
+		hdd_range_lock(inode, &range, start, end);
+		if (!verify_chain_seq(inode, chain, last)) {
+			hdd_range_unlock(inode, &range);
+			err = -EAGAIN;
+			partial = last;
+			goto cleanup;
+		}
+		if (last->bh)
+			lock_buffer(last->bh);
+		for (i = 0; i < count; i++)
+			*hdd_access_byte(inode, last->bh, offsets[depth-1] + i) = 0;
+		if (last->bh) {
+			unlock_buffer(last->bh);
+			mark_buffer_dirty_inode(last->bh, inode);
+		} else {
+			mark_inode_dirty(inode);
+		}
+		hdd_range_unlock(inode, &range);
+		set_buffer_new(bh_result);
+	}
+
+	/* ʵλ, ɼ¼ [豸+ʵʿ]  bh_result  */
+	hdd_map_bh(inode, bh_result, location, le32_to_cpu(last->key));
+
+	/* Ƿ SSD; Ǩδʵ, ֻͳ */
+	if (mapped && !unwritten && !nowait && !noacct)
+		hdd_promote_admit(inode, iblock, count, location, heat);
+
+	/* дĿӳ仺, ´ʱٶַ */
+	if (mapped && !unwritten)
+		hdd_map_cache_insert(inode, iblock, le32_to_cpu(last->key),
+				     count, location,
+				     count > blocks_to_boundary,
+				     last->bh ? last->bh->b_blocknr : 0,
+				     offsets[depth-1], gen);
+
 	/* ¼ǷΪһеһ:  11, 797  */
 	if (location == BLOCK_ON_HDD && count > blocks_to_boundary)
 		set_buffer_boundary(bh_result);
+
+	/* ӳ䵽һĽβ, Ԥֵַܵ */
+	if (mapped && !nowait && depth >= 2 && count > blocks_to_boundary)
+		hdd_readahead_siblings(inode, chain + depth - 2);
 	err = count; /* ֵΪȡֱӿ */
 
-	partial = chain + depth - 1;	/* the whole chain */
+	partial = last;	/* the whole chain */
 cleanup:
 	while (partial > chain) { /* ͷ·ϵļݿ */
 		brelse(partial->bh);
@@ -705,6 +1160,42 @@ int hdd_get_block(struct inode *inode, sector_t iblock,
 	return ret;/* 0 Ϊɹ */
 }
 
+/*
+ * ӳ map->m_lblk ʼ map->m_len , Ϊͬһ豸
+ * һ, Ҫͷ. ӳĿ; ն 0, ʱ m_len Ϊ 1.
+ */
+int hdd_map_blocks(struct inode *inode, struct hdd_map_blocks *map, int create)
+{
+	struct buffer_head bh;
+	unsigned int len = map->m_len;
+	int ret;
+
+	/* b_size  32 λֻ 32 λ, λǰƿ */
+	if (len > (UINT_MAX >> inode->i_blkbits))
+		len = UINT_MAX >> inode->i_blkbits;
+	bh.b_state = 0;
+	bh.b_size = (size_t) len << inode->i_blkbits;
+	ret = hdd_get_blocks(inode, map->m_lblk, len, &bh, create);
+
+	map->m_flags = 0;
+	if (ret < 0)
+		return ret;
+	if (!ret) {
+		map->m_len = 1;
+		return 0;
+	}
+
+	map->m_len = ret;
+	map->m_pblk = bh.b_blocknr;
+	map->m_bdev = bh.b_bdev;
+	map->m_flags = HDD_MAP_MAPPED;
+	if (buffer_new(&bh))
+		map->m_flags |= HDD_MAP_NEW;
+	if (buffer_boundary(&bh))
+		map->m_flags |= HDD_MAP_BOUNDARY;
+	return ret;
+}
+
 /* ͷһЩֱݿ, ΧΪ [p,q) */
 static inline void hdd_free_data(struct inode *inode, __le32 *p, __le32 *q)
 {
@@ -741,9 +1232,7 @@ static inline void hdd_free_data(struct inode *inode, __le32 *p, __le32 *q)
 		freed += count;
 	}
 
-	down_read(&sbi->sbi_rwsem);
 	percpu_counter_sub(&sbi->usr_blocks, freed);
-	up_read(&sbi->sbi_rwsem);	
 }
 
 /* [p, q) ΧǷȫΪ 0 */
@@ -779,17 +1268,17 @@ static Indirect *hdd_find_shared(struct inode *inode, int depth,
 	for (k = depth; k > 1 && !offsets[k-1]; k--)
 		;
 	/* ȡù· */
-	partial = hdd_get_branch(inode, k, offsets, chain, &err);
+	partial = hdd_get_branch(inode, k, offsets, chain, &err, 0);
 
 	/* 1.п鶼ѷ, Զ·Ϊ */
 	if (!partial)
 		partial = chain + k-1;
 
-	write_lock(&HDD_I(inode)->i_meta_lock);
+	write_seqlock(&HDD_I(inode)->i_meta_seq);
 
 	/* 2.partial ָĿ鲢δ, 򷵻 partial,  *top Ϊ0 */
 	if (!partial->key && *partial->p) {
-		write_unlock(&HDD_I(inode)->i_meta_lock);
+		write_sequnlock(&HDD_I(inode)->i_meta_seq);
 		goto no_top; /* ֱȥͷŹӿ */
 	}
 
@@ -818,7 +1307,7 @@ static Indirect *hdd_find_shared(struct inode *inode, int depth,
 		*p->p = 0;/* ȻͷŴ˵ַ, ʹ֮ͷŹַʱ, һ鿪ʼͷ */
 	}
 
-	write_unlock(&HDD_I(inode)->i_meta_lock);
+	write_sequnlock(&HDD_I(inode)->i_meta_seq);
 
 	while(partial > p) {	/* ͷ p ֮Ļ */
 		brelse(partial->bh);
@@ -842,9 +1331,15 @@ static void hdd_free_branches(struct inode *inode,
 
 	if (depth--) {/* ͷмַ */
 		int addr_offset = 0;
+		__le32 *pp;
 		if (0 == depth) 
 			addr_offset = HDD_ACCESS_END;
 
+		/* ȶӵַ鷢Ԥ, ͬȡ */
+		for (pp = p; pp < q; pp++)
+			if (*pp)
+				sb_breadahead(inode->i_sb, le32_to_cpu(*pp));
+
 		for ( ; p < q ; p++) {
 			nr = le32_to_cpu(*p); /* ͷŵĿ */
 			if (!nr) /* Ϊ 0, û, ͷһ */
@@ -889,6 +1384,7 @@ void hdd_truncate(struct inode *inode)
 	Indirect chain[4];	/* ʵʿ· */
 	Indirect *partial;	/* ʵ·еĴ */
 	__le32 nr = 0;		/*  */
+	struct hdd_range range;	/* ļķΧ */
 	//__le32 *p = NULL;	/* ڵַеĵַ */
 	//__le32 **addr = &p;
 
@@ -910,12 +1406,26 @@ void hdd_truncate(struct inode *inode)
 	block_truncate_page(inode->i_mapping,
 			inode->i_size, hdd_get_block);
 
+	if (hi->i_flags & HDD_EXTENTS_FL) {
+		mutex_lock(&hi->truncate_mutex);
+		down_write(&hi->i_data_sem);
+		hdd_discard_reservation(inode);
+		up_write(&hi->i_data_sem);
+		hdd_ext_truncate(inode);
+		mutex_unlock(&hi->truncate_mutex);
+		goto out;
+	}
+
 	/* ȡ iblock ·,  */
 	n = hdd_block_to_path(inode, iblock, offsets, NULL);
 	if (n == 0)
 		return;
 
 	mutex_lock(&hi->truncate_mutex);
+	hdd_range_lock(inode, &range, 0, HDD_RANGE_ALL); /* ų */
+	hdd_discard_reservation(inode); /* ͷſԤ */
+	/* ͷǰʧЧ, ·ٷؽͷŵĿ */
+	hdd_map_cache_invalidate(inode, iblock, HDD_RANGE_ALL);
 
 	/* ضʼֱӿ, ͷŶֱӿ */
 	if (n == 1) {
@@ -988,8 +1498,11 @@ do_indirects:
 			;
 	}
 
+	hdd_map_cache_invalidate(inode, iblock, HDD_RANGE_ALL);
+	hdd_range_unlock(inode, &range);
 	mutex_unlock(&hi->truncate_mutex);
 
+out:
 	inode->i_mtime = inode->i_ctime = CURRENT_TIME_SEC;
 
 	if (inode_needs_sync(inode)) {
@@ -1000,12 +1513,251 @@ do_indirects:
 	}
 }
 
+/* ͷ [start, end) еݿ,  hdd_punch_hole , ߳ truncate_mutex.
+ * Χǵ hdd_free_branches ͷ,
+ * ֻͷһеݿ, ַȫյһַ֮ͷ */
+static int hdd_ind_remove_space(struct inode *inode, long start, long end)
+{
+	__le32 *i_data = HDD_I(inode)->i_data;
+	struct hdd_inode_info *hi = HDD_I(inode);
+	int offsets[4];
+	Indirect chain[4];
+	Indirect *partial, *p;
+	struct buffer_head *bh;
+	long iblock = start, count;
+	int n, k, boundary, err = 0;
+	__le32 nr;
+
+	while (iblock < end) {
+		n = hdd_block_to_path(inode, iblock, offsets, &boundary);
+		if (n == 0)
+			break;
+
+		/* ֱӿ */
+		if (n == 1) {
+			count = min_t(long, boundary + 1, end - iblock);
+			access_info_sub(inode, i_data, offsets[0], count);
+			hdd_free_data(inode, i_data + offsets[0],
+				      i_data + offsets[0] + count);
+			iblock += count;
+			continue;
+		}
+
+		partial = hdd_get_branch(inode, n, offsets, chain, &err, 0);
+		if (err)
+			goto release;
+
+		/* ·жڵַһ, ǿն */
+		if (partial && partial < chain + n - 1) {
+			k = partial - chain;
+			iblock += hdd_subtree_blocks(n, k) -
+				  hdd_subtree_index(n, k, offsets);
+			goto release;
+		}
+
+		/* ʼ iblock ȫڷΧڵ */
+		for (k = 0; k < n - 1; k++)
+			if (!hdd_subtree_index(n, k, offsets)
+			&& iblock + hdd_subtree_blocks(n, k) <= end)
+				break;
+
+		if (k < n - 1) {
+			p = chain + k;
+			write_seqlock(&hi->i_meta_seq);
+			nr = *p->p;
+			*p->p = 0;
+			write_sequnlock(&hi->i_meta_seq);
+			if (p->bh)
+				mark_buffer_dirty_inode(p->bh, inode);
+			else
+				mark_inode_dirty(inode);
+			hdd_free_branches(inode, &nr, &nr + 1, n - 1 - k, NULL);
+			iblock += hdd_subtree_blocks(n, k);
+			partial = chain + n - 1;
+			goto release;
+		}
+
+		/* ֻͷһеĲݿ */
+		p = chain + n - 1;
+		bh = p->bh;
+		count = min_t(long, boundary + 1, end - iblock);
+		access_info_sub(inode, (__le32 *) bh->b_data, offsets[n-1], count);
+		hdd_free_data(inode, p->p, p->p + count);
+		mark_buffer_dirty_inode(bh, inode);
+		iblock += count;
+
+		/* һȫ, Ӹժ²ͷ */
+		if (all_zeroes((__le32 *)(bh->b_data + HDD_ACCESS_END),
+			       (__le32 *) bh->b_data + 1024)) {
+			write_seqlock(&hi->i_meta_seq);
+			nr = *(p - 1)->p;
+			*(p - 1)->p = 0;
+			write_sequnlock(&hi->i_meta_seq);
+			if ((p - 1)->bh)
+				mark_buffer_dirty_inode((p - 1)->bh, inode);
+			else
+				mark_inode_dirty(inode);
+			bforget(bh);
+			p->bh = NULL;
+			hdd_free_blocks(inode, le32_to_cpu(nr), 1);
+		}
+		partial = p;
+release:
+		if (!partial)
+			partial = chain + n - 1;
+		while (partial > chain) {
+			brelse(partial->bh);
+			partial--;
+		}
+		if (err)
+			break;
+	}
+	return err;
+}
+
+/* ҳ [from, to) Ĳֿ, ;  block_truncate_page,
+ * նδд鱾Ϊ, Ϊ */
+static int hdd_zero_partial_block(struct inode *inode, loff_t from, loff_t to)
+{
+	unsigned blocksize = 1 << inode->i_blkbits;
+	pgoff_t index = from >> PAGE_CACHE_SHIFT;
+	unsigned offset = from & (PAGE_CACHE_SIZE - 1);
+	sector_t iblock;
+	struct buffer_head *bh;
+	struct page *page;
+	unsigned pos;
+	int err = 0;
+
+	page = grab_cache_page(inode->i_mapping, index);
+	if (!page)
+		return -ENOMEM;
+	if (!page_has_buffers(page))
+		create_empty_buffers(page, blocksize, 0);
+
+	/* ҵ from ڿĻͷ */
+	iblock = (sector_t) index << (PAGE_CACHE_SHIFT - inode->i_blkbits);
+	bh = page_buffers(page);
+	for (pos = blocksize; offset >= pos; pos += blocksize) {
+		bh = bh->b_this_page;
+		iblock++;
+	}
+
+	/* ӳٿӳ䵽Ч, ѷһ */
+	if (!buffer_mapped(bh)) {
+		err = hdd_get_block(inode, iblock, bh, HDD_GET_BLOCKS_NOACCT);
+		clear_buffer_unwritten(bh);
+		if (err || !buffer_mapped(bh))
+			goto unlock;	/* ն,  */
+	}
+
+	if (PageUptodate(page))
+		set_buffer_uptodate(bh);
+	if (!buffer_uptodate(bh) && !buffer_delay(bh)) {
+		ll_rw_block(READ, 1, &bh);
+		wait_on_buffer(bh);
+		if (!buffer_uptodate(bh)) {
+			err = -EIO;
+			goto unlock;
+		}
+	}
+
+	zero_user(page, offset, to - from);
+	mark_buffer_dirty(bh);
+
+unlock:
+	unlock_page(page);
+	page_cache_release(page);
+	return err;
+}
+
+/* ļд: ͷ [offset, offset+len) ڵ, ԵĲֿ */
+static int hdd_punch_hole(struct inode *inode, loff_t offset, loff_t len)
+{
+	struct address_space *mapping = inode->i_mapping;
+	struct hdd_inode_info *hi = HDD_I(inode);
+	unsigned int blkbits = inode->i_blkbits;
+	loff_t end = offset + len;
+	loff_t size = i_size_read(inode);
+	loff_t first, last;
+	struct hdd_range range;
+	int err = 0;
+
+	if (IS_APPEND(inode) || IS_IMMUTABLE(inode))
+		return -EPERM;
+	if (offset >= size)
+		return 0;
+	if (end > size)
+		end = size;
+
+	first = (offset + (1 << blkbits) - 1) >> blkbits;
+	last = end >> blkbits;
+
+	/* ֻֿ, ͷ */
+	if (first > last) {
+		err = hdd_zero_partial_block(inode, offset, end);
+	} else {
+		if (offset < first << blkbits)
+			err = hdd_zero_partial_block(inode, offset,
+						     first << blkbits);
+		if (!err && end > last << blkbits)
+			err = hdd_zero_partial_block(inode, last << blkbits,
+						     end);
+	}
+	if (err || first >= last)
+		goto out;
+
+	/* ҳеҳ, ӳٷԤ֮ͷ */
+	unmap_mapping_range(mapping, first << blkbits,
+			    (last - first) << blkbits, 0);
+	truncate_inode_pages_range(mapping, first << blkbits,
+				   (last << blkbits) - 1);
+
+	mutex_lock(&hi->truncate_mutex);
+	hdd_range_lock(inode, &range, 0, HDD_RANGE_ALL);
+	hdd_map_cache_invalidate(inode, first, last);	/* ͷǰʧЧ */
+	if (hi->i_flags & HDD_EXTENTS_FL)
+		err = hdd_ext_remove_space(inode, first, last);
+	else
+		err = hdd_ind_remove_space(inode, first, last);
+	hdd_map_cache_invalidate(inode, first, last);
+	hdd_range_unlock(inode, &range);
+	mutex_unlock(&hi->truncate_mutex);
+
+	/* ҳĻͷӳ䵽ͷŵĿ, ٶһ */
+	unmap_mapping_range(mapping, first << blkbits,
+			    (last - first) << blkbits, 0);
+	truncate_inode_pages_range(mapping, first << blkbits,
+				   (last << blkbits) - 1);
+
+out:
+	inode->i_mtime = inode->i_ctime = CURRENT_TIME_SEC;
+	if (inode_needs_sync(inode)) {
+		sync_mapping_buffers(mapping);
+		hdd_sync_inode(inode);
+	} else {
+		mark_inode_dirty(inode);
+	}
+	return err;
+}
+
 /* ɾϵ inode */
 void hdd_delete_inode(struct inode *inode)
 {
+	struct hdd_sb_info *sbi = HDD_SB(inode->i_sb);
+	struct hdd_inode_info *hi = HDD_I(inode);
+
 	truncate_inode_pages(&inode->i_data, 0);
 
-	if (is_bad_inode(inode)) {
+	/* ͷŵ inode , ɺ̨̼߳ */
+	if (is_bad_inode(inode) || (hi->i_flags & HDD_PENDING_FREE_FL)) {
+		clear_inode(inode);
+		return;
+	}
+
+	/* ļͷ, ɺ̷̨߳ͷ */
+	if (sbi->s_reclaim_task && S_ISREG(inode->i_mode)
+	&& inode->i_blocks >= HDD_RECLAIM_MIN_BLOCKS) {
+		hdd_pending_add(inode);
 		clear_inode(inode);
 		return;
 	}
@@ -1022,6 +1774,244 @@ void hdd_delete_inode(struct inode *inode)
 	hdd_free_inode (inode); /* ͷ inode  */
 }
 
+/* ɾ inode ͷ: д inode , ٸĳе */
+static void hdd_pending_add(struct inode *inode)
+{
+	struct super_block *sb = inode->i_sb;
+	struct hdd_sb_info *sbi = HDD_SB(sb);
+	struct hdd_inode_info *hi = HDD_I(inode);
+
+	mutex_lock(&sbi->s_pending_lock);
+	hi->i_dtime = sbi->s_pending_head;
+	hi->i_flags |= HDD_PENDING_FREE_FL;
+	hdd_write_inode(inode, inode_needs_sync(inode));
+
+	sbi->s_pending_head = inode->i_ino;
+	sbi->hdd_sb->s_pending_free_head = cpu_to_le32(inode->i_ino);
+	hdd_mark_sb_dirty(sb);
+	mutex_unlock(&sbi->s_pending_lock);
+
+	percpu_counter_add(&sbi->pending_free_blks, inode->i_blocks);
+	wake_up_process(sbi->s_reclaim_task);
+}
+
+/* Ӵͷժ ino, next Ϊ */
+static void hdd_pending_del(struct super_block *sb, unsigned int ino,
+	unsigned int next)
+{
+	struct hdd_sb_info *sbi = HDD_SB(sb);
+	struct hdd_inode *raw;
+	struct buffer_head *bh;
+	unsigned int cur, link;
+
+	mutex_lock(&sbi->s_pending_lock);
+	if (sbi->s_pending_head == ino) {
+		sbi->s_pending_head = next;
+		sbi->hdd_sb->s_pending_free_head = cpu_to_le32(next);
+		hdd_mark_sb_dirty(sb);
+		goto out;
+	}
+
+	/* ڼ׼ inode, ҵǰ޸ */
+	for (cur = sbi->s_pending_head; cur; cur = link) {
+		raw = hdd_get_inode(sb, cur, &bh);
+		if (IS_ERR(raw))
+			break;
+		link = le32_to_cpu(raw->i_dtime);
+		if (link == ino) {
+			raw->i_dtime = cpu_to_le32(next);
+			mark_buffer_dirty(bh);
+			brelse(bh);
+			goto out;
+		}
+		brelse(bh);
+	}
+	hdd_msg(sb, KERN_ERR, __func__, "inode %u not in pending list", ino);
+out:
+	mutex_unlock(&sbi->s_pending_lock);
+}
+
+/* ѷϽ(߼). ַļֻ i_data һַе
+ * һ, ȡ; Ŀһض */
+static unsigned long hdd_alloc_end(struct inode *inode)
+{
+	__le32 *i_data = HDD_I(inode)->i_data;
+	const unsigned long ind = HDD_NDIR_BLOCKS + HDD_ADDR_PER_BLOCK;
+	const unsigned long dind = ind + ((unsigned long) HDD_ADDR_PER_BLOCK << 10);
+	struct buffer_head *bh;
+	unsigned long start, span;
+	__le32 *p;
+	int i, n;
+
+	if (HDD_I(inode)->i_flags & HDD_EXTENTS_FL)
+		return hdd_ext_alloc_end(inode);
+
+	if (i_data[HDD_TIND_BLOCK]) {
+		n = HDD_TIND_BLOCK;	/* ÿһöμַ */
+		start = dind;
+		span = (unsigned long) HDD_ADDR_PER_BLOCK << 10;
+	} else if (i_data[HDD_DIND_BLOCK]) {
+		n = HDD_DIND_BLOCK;	/* ÿһһַ */
+		start = ind;
+		span = HDD_ADDR_PER_BLOCK;
+	} else if (i_data[HDD_IND_BLOCK]) {
+		return ind;
+	} else {
+		for (i = HDD_NDIR_BLOCKS; i > 0; i--)
+			if (i_data[i - 1])
+				break;
+		return i;
+	}
+
+	bh = sb_bread(inode->i_sb, le32_to_cpu(i_data[n]));
+	if (!bh)
+		return ~0UL;	/* ,  i_size ض */
+	p = (__le32 *) bh->b_data;
+	for (i = 1024; i > 0; i--)
+		if (p[i - 1])
+			break;
+	brelse(bh);
+	return start + i * span;
+}
+
+/* ͷ inode ݿ, Ϊʱ 0 */
+static int hdd_reclaim_one(struct super_block *sb)
+{
+	struct hdd_sb_info *sbi = HDD_SB(sb);
+	struct hdd_inode_info *hi;
+	struct inode *inode;
+	struct hdd_inode *raw;
+	struct buffer_head *bh;
+	unsigned int ino, next;
+	unsigned long end;
+	blkcnt_t blocks;
+	loff_t size;
+
+	mutex_lock(&sbi->s_pending_lock);
+	ino = sbi->s_pending_head;
+	mutex_unlock(&sbi->s_pending_lock);
+	if (!ino)
+		return 0;
+
+	inode = hdd_iget(sb, ino);
+	if (IS_ERR(inode)) {
+		/* ޷ȡ, ,  fsck  */
+		hdd_msg(sb, KERN_ERR, __func__,
+			"cannot read pending inode %u", ino);
+		raw = hdd_get_inode(sb, ino, &bh);
+		next = IS_ERR(raw) ? 0 : le32_to_cpu(raw->i_dtime);
+		if (!IS_ERR(raw))
+			brelse(bh);
+		hdd_pending_del(sb, ino, next);
+		return 1;
+	}
+	hi = HDD_I(inode);
+
+	/* βһض, ÿ֮д inode, жϺ´ιؼ;
+	   ÿһѷ, ϡļβĿնռ */
+	for (;;) {
+		end = hdd_alloc_end(inode);
+		if (end < (inode->i_size >> HDD_BLOCK_LOG_SIZE))
+			inode->i_size = (loff_t) end << HDD_BLOCK_LOG_SIZE;
+		size = inode->i_size - ((loff_t) HDD_RECLAIM_BATCH << HDD_BLOCK_LOG_SIZE);
+		if (!inode->i_blocks)
+			size = 0;	/* ûп, һνضϼ */
+		if (size < 0)
+			size = 0;
+		size &= ~((loff_t) HDD_BLOCK_SIZE - 1);
+
+		blocks = inode->i_blocks;
+		inode->i_size = size;
+		hdd_truncate(inode);
+		percpu_counter_sub(&sbi->pending_free_blks,
+				   blocks - inode->i_blocks);
+		hdd_write_inode(inode, 0);
+		cond_resched();
+
+		if (!size || kthread_should_stop())
+			break;
+	}
+
+	/* ݿȫͷ, ժº iput ͷ inode  */
+	if (!inode->i_size) {
+		percpu_counter_sub(&sbi->pending_free_blks, inode->i_blocks);
+		hdd_pending_del(sb, ino, hi->i_dtime);
+		hi->i_flags &= ~HDD_PENDING_FREE_FL;
+		hi->i_dtime = 0;
+		mark_inode_dirty(inode);
+	}
+	iput(inode);
+	return 1;
+}
+
+/* ̨ͷ߳, Ҳд */
+static int hdd_reclaim_thread(void *data)
+{
+	struct super_block *sb = data;
+	struct hdd_sb_info *sbi = HDD_SB(sb);
+	long timeout;
+
+	sbi->s_acc_next = jiffies + sbi->s_acc_interval * HZ;
+	while (!kthread_should_stop()) {
+		/* ʱѷдַ */
+		if (sbi->s_acc_interval && time_after_eq(jiffies, sbi->s_acc_next)) {
+			hdd_access_fold(sb);
+			sbi->s_acc_next = jiffies + sbi->s_acc_interval * HZ;
+		}
+		hdd_sketch_age(sbi);	/* ʱ */
+
+		if (hdd_reclaim_one(sb))
+			continue;
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!sbi->s_pending_head && !kthread_should_stop()) {
+			if (!sbi->s_acc_interval)
+				schedule();
+			else if ((timeout = sbi->s_acc_next - jiffies) > 0)
+				schedule_timeout(timeout);
+		}
+		__set_current_state(TASK_RUNNING);
+	}
+	return 0;
+}
+
+/* ͳϴδͷĿ, ̨ͷ߳ */
+int hdd_start_reclaim(struct super_block *sb)
+{
+	struct hdd_sb_info *sbi = HDD_SB(sb);
+	struct task_struct *task;
+	struct hdd_inode *raw;
+	struct buffer_head *bh;
+	unsigned int ino, n = 0;
+
+	for (ino = sbi->s_pending_head; ino && n < sbi->inodes_count; n++) {
+		raw = hdd_get_inode(sb, ino, &bh);
+		if (IS_ERR(raw))
+			break;
+		percpu_counter_add(&sbi->pending_free_blks,
+				   le32_to_cpu(raw->i_blocks));
+		ino = le32_to_cpu(raw->i_dtime);
+		brelse(bh);
+	}
+
+	task = kthread_run(hdd_reclaim_thread, sb, "hdd_reclaim-%s", sb->s_id);
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+	sbi->s_reclaim_task = task;
+	return 0;
+}
+
+/* ֹ̨ͣͷ߳, δͷ inode  */
+void hdd_stop_reclaim(struct super_block *sb)
+{
+	struct hdd_sb_info *sbi = HDD_SB(sb);
+
+	if (sbi->s_reclaim_task) {
+		kthread_stop(sbi->s_reclaim_task);
+		sbi->s_reclaim_task = NULL;
+	}
+}
+
 /* ͬ inode */
 int hdd_sync_inode(struct inode *inode)
 {
@@ -1036,15 +2026,24 @@ int hdd_sync_inode(struct inode *inode)
 void access_info_init(struct inode *inode,struct buffer_head *bh, unsigned int offset)
 {
 /*
-  ߳ inode->truncate_lock,
+  ߳и offset ķΧ( hdd_range_lock),
   ڵú bh  inode Ϊ.
  
   bh Ϊ NULL, ʾ offset Ϊֱӿƫ, Ϊӿƫ.
  */
+	/* ¿λ HDD, λλͼвı־ */
+	if (!bh)
+		HDD_I(inode)->i_direct_bits &= ~(1 << offset);
+	else
+		ext2_clear_bit(offset - HDD_ADDR_START, bh->b_data);
+
+	/* ֽвδд־ */
+	*hdd_access_byte(inode, bh, offset) = 0;
 }
 
 /* ӷʼ, ʼƽֵ, ǨƵ SSD, λ */
-int access_info_inc(struct inode * inode, Indirect *branch, unsigned int offset)
+int access_info_inc(struct inode * inode, Indirect *branch, unsigned int offset,
+	unsigned int gen)
 {
 /*
   branch.bh Ϊ NULL, ʾ offset Ϊֱӿƫ, Ϊӿƫ.
@@ -1054,13 +2053,119 @@ int access_info_inc(struct inode * inode, Indirect *branch, unsigned int offset)
 
   ԭHDD, SSDϵķϢ, ʼ, жǷҪǨ
 	  branch->key ¼˿, ڴǨ, Ҫֵ. bh Ϊ.
+	  Ǩƺ hdd_map_cache_invalidate ÿĻӳ.
 
   ԭSSD, SSDϵķϢ,
 
    1 ʾSSD, 0 ʾ HDD 
+
+  ֻÿ CPU , ޸ĵַ,  access_info_fold д.
+  gen Ϊ·ǰȡõӳ.
  */
-	//struct buffer_head *bh;
-	return 0;
+	struct hdd_access_rec rec;
+
+	rec.gen = gen;
+	rec.ablk = branch->bh ? branch->bh->b_blocknr : 0;
+	rec.aidx = offset;
+	hdd_access_note(inode, &rec);
+
+	return hdd_block_location(inode, branch, offset);
+}
+
+/* ѵַ(bh Ϊ NULL ʱΪֱӿ)ķֽ˥ǰԪ, Ƿ޸.
+ * ߳ s_heat_sem , Լ bh ֱӿķΧ */
+int access_info_age(struct inode *inode, struct buffer_head *bh)
+{
+	void *data = bh ? (void *) bh->b_data : (void *) HDD_I(inode)->i_data;
+	__u8 *level = hdd_access_byte(inode, bh, bh ? HDD_ADDR_START : 0);
+	unsigned int i, n = bh ? HDD_ADDR_PER_BLOCK : HDD_NDIR_BLOCKS;
+	unsigned int shift, epoch = HDD_SB(inode->i_sb)->s_heat_epoch;
+
+	shift = hdd_heat_shift(inode, hdd_heat_stamp(inode, data));
+	if (!shift)
+		return 0;
+
+	/* blks_per_lvl ƽԪʱѼ, ֻķֽ */
+	for (i = 0; i < n; i++)
+		if (level[i] != HDD_ACCESS_UNWRITTEN)
+			level[i] >>= shift;
+
+	if (bh)
+		*(__le16 *) ((char *) data + HDD_ADDR_EPOCH) = cpu_to_le16(epoch);
+	else
+		HDD_I(inode)->i_heat_epoch = epoch;
+	return 1;
+}
+
+/* ѷ delta дֽ, ablk Ϊ 0 ʱֱӿ; ߳
+ * truncate_mutex, ַ鲻ᱻͷ */
+void access_info_fold(struct inode *inode, unsigned int ablk,
+	const __u8 *delta)
+{
+	struct hdd_sb_info *sbi = HDD_SB(inode->i_sb);
+	struct buffer_head *bh = NULL;
+	struct hdd_range range;
+	__le32 *addr;
+	__u8 *level;
+	unsigned int i, n, first, new;
+	u64 total = 0;
+	int aged;
+
+	if (ablk) {
+		bh = sb_bread(inode->i_sb, ablk);
+		if (!bh)
+			return;
+		down_read(&sbi->s_heat_sem);
+		lock_buffer(bh);	/* , δдת޸ķֽڻ */
+		addr = (__le32 *) bh->b_data;
+		first = HDD_ADDR_START;
+		n = HDD_ADDR_PER_BLOCK;
+	} else {
+		down_read(&sbi->s_heat_sem);
+		hdd_range_lock(inode, &range, 0, HDD_NDIR_BLOCKS);
+		addr = HDD_I(inode)->i_data;
+		first = 0;
+		n = HDD_NDIR_BLOCKS;
+	}
+
+	/* ˥ǰԪ, ˥ļ */
+	aged = access_info_age(inode, bh);
+	for (i = 0; i < n; i++) {
+		if (!delta[i] || !addr[first + i])
+			continue;
+		level = hdd_access_byte(inode, bh, first + i);
+		if (*level == HDD_ACCESS_UNWRITTEN)
+			continue;
+
+		/* ʼ𱥺 FMC_MAX_LEVELS - 1,  0  blks_per_lvl */
+		new = min_t(unsigned int, *level + delta[i], FMC_MAX_LEVELS - 1);
+		if (new != *level) {
+			if (*level)
+				percpu_counter_dec(&sbi->blks_per_lvl[*level]);
+			percpu_counter_inc(&sbi->blks_per_lvl[new]);
+			hdd_promote_move(sbi, *level, new);
+			*level = new;
+		}
+		total += delta[i];
+	}
+
+	if (bh) {
+		unlock_buffer(bh);
+		up_read(&sbi->s_heat_sem);
+		if (total || aged)
+			mark_buffer_dirty_inode(bh, inode);
+		brelse(bh);
+	} else {
+		hdd_range_unlock(inode, &range);
+		up_read(&sbi->s_heat_sem);
+		if (total || aged)
+			mark_inode_dirty(inode);
+	}
+
+	if (total) {
+		percpu_counter_add(&sbi->total_access, total);
+		hdd_mark_sb_dirty(inode->i_sb);
+	}
 }
 
 /* ͷݿ, ʼ, SSD, ͷſ, ǿΪ 0 */
@@ -1070,8 +2175,65 @@ void access_info_sub(struct inode *inode, __le32 *data, int offset, int count)
 	 * offset ʾҪͷŵʼ data еƫ.
 	 * count ʾҪͷŵĿ.
 	 */
+	struct hdd_inode_info *hi = HDD_I(inode);
+	struct hdd_sb_info *sbi = HDD_SB(inode->i_sb);
+	unsigned int nr, shift;
+	__u8 level;
+	int i, on_ssd;
+
+	/* ֽڿͣھɼԪ, blks_per_lvl м˥ļ */
+	down_read(&sbi->s_heat_sem);
+	shift = hdd_heat_shift(inode, hdd_heat_stamp(inode, data));
+	for (i = offset; i < offset + count; i++) {
+		/* ͷŵĿƳڵķʼ */
+		if (data == hi->i_data)
+			level = hi->i_direct_blks[i];
+		else
+			level = *((__u8 *) data + HDD_ADDR_BMAP_END + i - HDD_ADDR_START);
+		if (level != HDD_ACCESS_UNWRITTEN && (level >> shift) && data[i]) {
+			percpu_counter_dec(&sbi->blks_per_lvl[level >> shift]);
+			hdd_promote_move(sbi, level >> shift, 0);
+		}
+
+		if (data == hi->i_data) {
+			on_ssd = hi->i_direct_bits & (1 << i);
+			hi->i_direct_bits &= ~(1 << i);
+			hi->i_direct_blks[i] = 0;
+		} else {
+			on_ssd = ext2_test_bit(i - HDD_ADDR_START, data);
+			ext2_clear_bit(i - HDD_ADDR_START, data);
+			*((__u8 *) data + HDD_ADDR_BMAP_END + i - HDD_ADDR_START) = 0;
+		}
+
+		/* SSD ϵĿ齻 SSD,  0, ֮ hdd_free_data  */
+		nr = le32_to_cpu(data[i]);
+		if (on_ssd && nr) {
+			hdd_ssd_release_blocks(inode, nr, 1);
+			data[i] = 0;
+		}
+	}
+	up_read(&sbi->s_heat_sem);
+}
+
+/* ͷ SSD ϴ block ʼ count ,  SSD Ŀп.
+ * fmc_ssd ûп, ֻܹ黹,  block ݲʹ */
+void hdd_ssd_release_blocks(struct inode *inode, unsigned int block,
+	unsigned long count)
+{
+	struct hdd_sb_info *sbi = HDD_SB(inode->i_sb);
+	struct hdd_inode_info *hi = HDD_I(inode);
+
+	percpu_counter_sub(&sbi->ssd_blks_count, count);
 
+	mutex_lock(&sbi->ssd_mutex);
+	if (sbi->ssd_info)
+		percpu_counter_add(&sbi->ssd_info->s_freeblocks_counter, count);
+	mutex_unlock(&sbi->ssd_mutex);
 
+	spin_lock(&inode->i_lock);
+	hi->i_ssd_blocks -= min_t(unsigned long, count, hi->i_ssd_blocks);
+	spin_unlock(&inode->i_lock);
+	mark_inode_dirty(inode);
 }
 
 /* ļ */
@@ -1099,7 +2261,8 @@ static int hdd_readpage(struct file *file, struct page *page)
 static int hdd_readpages(struct file *file, struct address_space *mapping,
 	struct list_head *pages, unsigned nr_pages)
 {
-	return mpage_readpages(mapping, pages, nr_pages, hdd_get_block);
+	/* 豸λ÷,  SSD ϵҳ HDD  bio */
+	return hdd_mpage_readpages(mapping, pages, nr_pages);
 }
 
 /* дһҳ */
@@ -1108,11 +2271,11 @@ static int hdd_writepage(struct page *page, struct writeback_control *wbc)
 	return block_write_full_page(page, hdd_get_block, wbc);
 }
 
-/* дҳ */
+/* дҳ: 豸ۼ,  SSD ϵҳ HDD  bio */
 static int hdd_writepages(struct address_space *mapping, 
 	struct writeback_control *wbc)
 {
-	return mpage_writepages(mapping, wbc, hdd_get_block);
+	return hdd_mpage_writepages(mapping, wbc, hdd_get_block);
 }
 
 int __hdd_write_begin(struct file *file, struct address_space *mapping,
@@ -1136,13 +2299,377 @@ static ssize_t hdd_direct_IO(int rw, struct kiocb *iocb,
 {
 	struct file *file = iocb->ki_filp;
 	struct inode *inode = file->f_mapping->host;
+	ssize_t ret;
+
+	/* дĿ鰴ӳκ豸ֱύ, ཻ blockdev_direct_IO */
+	ret = hdd_dio_tiered(rw, iocb, iov, offset, nr_segs);
+	if (ret != -ENOTBLK)
+		return ret;
+
+	/* blockdev_direct_IO ֻ HDD, 漰 SSD ϵĿʱ 0, û */
+	if (rw == READ && hdd_dio_on_ssd(inode, offset, iov_length(iov, nr_segs)))
+		return 0;
 
 	return blockdev_direct_IO(rw, iocb, inode, inode->i_sb->s_bdev, iov,
-		offset, nr_segs, hdd_get_block, NULL);
+		offset, nr_segs, hdd_dio_get_block, NULL);
+}
+
+/* ӳٷ: дǰĿӳΪЧ */
+#define HDD_DELAYED_BLOCK	((sector_t) ~0UL)
+/* ӳٷʱһη漰ҳ, 4K ʱΪ 1M */
+#define HDD_DA_MAX_PAGES	256
+/* ӳٷԤʱ, ΪӿԪ */
+#define HDD_DA_META_SLACK	16
+
+/* ΪһӳٿԤռ, ʱ -ENOSPC */
+static int hdd_da_reserve_space(struct inode *inode)
+{
+	struct hdd_sb_info *sbi = HDD_SB(inode->i_sb);
+	struct hdd_inode_info *hi = HDD_I(inode);
+	s64 free_blocks, dirty_blocks;
+
+	free_blocks = percpu_counter_read_positive(&sbi->free_blks_count);
+	dirty_blocks = percpu_counter_read_positive(&sbi->dirty_blks_count);
+
+	/* ԤĿջҪӿ, ÿַһ */
+	dirty_blocks += dirty_blocks / HDD_ADDR_PER_BLOCK + HDD_DA_META_SLACK;
+	if (free_blocks < dirty_blocks + 1 + HDD_DA_WATERMARK) {
+		/* ӽʱʹþȷֵ */
+		free_blocks = percpu_counter_sum_positive(&sbi->free_blks_count);
+		dirty_blocks = percpu_counter_sum_positive(&sbi->dirty_blks_count);
+		dirty_blocks += dirty_blocks / HDD_ADDR_PER_BLOCK +
+			HDD_DA_META_SLACK;
+		if (free_blocks < dirty_blocks + 1)
+			return -ENOSPC;
+	}
+
+	percpu_counter_inc(&sbi->dirty_blks_count);
+
+	spin_lock(&inode->i_lock);
+	hi->i_reserved_data_blocks++;
+	spin_unlock(&inode->i_lock);
+	return 0;
+}
+
+/* ͷ inode  to_free ӳٿԤ */
+void hdd_da_release_space(struct inode *inode, int to_free)
+{
+	struct hdd_sb_info *sbi = HDD_SB(inode->i_sb);
+	struct hdd_inode_info *hi = HDD_I(inode);
+
+	if (!to_free)
+		return;
+
+	spin_lock(&inode->i_lock);
+	if (unlikely(to_free > hi->i_reserved_data_blocks)) {
+		hdd_msg(inode->i_sb, KERN_WARNING, "hdd_da_release_space",
+			"ino %lu, releasing %d blocks with only %u reserved",
+			inode->i_ino, to_free, hi->i_reserved_data_blocks);
+		to_free = hi->i_reserved_data_blocks;
+	}
+	hi->i_reserved_data_blocks -= to_free;
+	spin_unlock(&inode->i_lock);
+
+	percpu_counter_sub(&sbi->dirty_blks_count, to_free);
+}
+
+/* ӳٷ write_begin: ѷĿֱӳ, նֻԤռ */
+static int hdd_da_get_block_prep(struct inode *inode, sector_t iblock,
+	struct buffer_head *bh_result, int create)
+{
+	int ret;
+
+	BUG_ON(create == 0);
+	BUG_ON(bh_result->b_size != inode->i_sb->s_blocksize);
+
+	clear_buffer_unwritten(bh_result);
+	ret = hdd_get_blocks(inode, iblock, 1, bh_result, 0);
+	if (ret > 0)	/* Ѵ */
+		return 0;
+	if (ret < 0)
+		return ret;
+
+	/* Ԥδдռпռ, ֱתΪд, Ԥ */
+	if (buffer_unwritten(bh_result)) {
+		clear_buffer_unwritten(bh_result);
+		ret = hdd_get_blocks(inode, iblock, 1, bh_result,
+				     HDD_GET_BLOCKS_CREATE);
+		return ret < 0 ? ret : 0;
+	}
+
+	ret = hdd_da_reserve_space(inode);
+	if (ret)
+		return ret;
+
+	/* ӳ䵽Ч, Ϊӳٿ, дʱٷ */
+	map_bh(bh_result, inode->i_sb, HDD_DELAYED_BLOCK);
+	set_buffer_new(bh_result);
+	set_buffer_delay(bh_result);
+	return 0;
+}
+
+/* ӳٷĻд: , ͷӦԤ */
+static int hdd_da_get_block_write(struct inode *inode, sector_t iblock,
+	struct buffer_head *bh_result, int create)
+{
+	int delayed = buffer_delay(bh_result);
+	int ret;
+
+	ret = hdd_get_blocks(inode, iblock, 1, bh_result,
+			     delayed ? create | HDD_GET_BLOCKS_DELALLOC : create);
+	if (ret <= 0)
+		return ret;
+
+	if (delayed)
+		hdd_da_release_space(inode, 1);
+	bh_result->b_size = (ret << inode->i_blkbits);
+	return 0;
+}
+
+/* ҳǷӳٿ */
+static int hdd_page_has_delay(struct page *page)
+{
+	struct buffer_head *head, *bh;
+
+	if (!page_has_buffers(page))
+		return 0;
+
+	bh = head = page_buffers(page);
+	do {
+		if (buffer_delay(bh))
+			return 1;
+	} while ((bh = bh->b_this_page) != head);
+	return 0;
+}
+
+/* һ, ӳٿѼҳ, ϴ, ̬ */
+struct hdd_da_run {
+	struct page	*pages[HDD_DA_MAX_PAGES];
+	int		nr_pages;
+};
+
+/* ȡ run ߼ block Ļͷ, first Ϊҳ׸߼ */
+static struct buffer_head *hdd_da_run_bh(struct hdd_da_run *run,
+	sector_t first, sector_t block, unsigned int blkbits)
+{
+	int shift = PAGE_CACHE_SHIFT - blkbits;
+	struct page *page = run->pages[(block - first) >> shift];
+	struct buffer_head *bh = page_buffers(page);
+	int n = (block - first) & ((1 << shift) - 1);
+
+	while (n--)
+		bh = bh->b_this_page;
+	return bh;
+}
+
+/* Ϊ run ӳٿһη̿, ȻͷЩҳ */
+static int hdd_da_map_run(struct inode *inode, struct hdd_da_run *run)
+{
+	unsigned int blkbits = inode->i_blkbits;
+	int shift = PAGE_CACHE_SHIFT - blkbits;
+	struct hdd_map_blocks map;
+	struct buffer_head *bh;
+	sector_t first, last, cur, end;
+	int i, ret = 0;
+
+	first = (sector_t) run->pages[0]->index << shift;
+	last = (sector_t) (run->pages[run->nr_pages - 1]->index + 1) << shift;
+
+	for (cur = first; cur < last; ) {
+		if (!buffer_delay(hdd_da_run_bh(run, first, cur, blkbits))) {
+			cur++;
+			continue;
+		}
+
+		/* ӳٿ [cur, end) */
+		for (end = cur + 1; end < last; end++)
+			if (!buffer_delay(hdd_da_run_bh(run, first, end, blkbits)))
+				break;
+
+		map.m_lblk = cur;
+		map.m_len = end - cur;
+		ret = hdd_map_blocks(inode, &map,
+				HDD_GET_BLOCKS_CREATE | HDD_GET_BLOCKS_DELALLOC);
+		if (ret <= 0) {
+			if (!ret)
+				ret = -EIO;
+			break;
+		}
+
+		for (i = 0; i < ret; i++) {
+			bh = hdd_da_run_bh(run, first, cur + i, blkbits);
+			bh->b_bdev = map.m_bdev;
+			bh->b_blocknr = map.m_pblk + i;
+			clear_buffer_delay(bh);
+			if (map.m_flags & HDD_MAP_NEW)
+				unmap_underlying_metadata(bh->b_bdev,
+							  bh->b_blocknr);
+		}
+		hdd_da_release_space(inode, ret);
+		cur += ret;
+		ret = 0;
+	}
+
+	for (i = 0; i < run->nr_pages; i++) {
+		unlock_page(run->pages[i]);
+		page_cache_release(run->pages[i]);
+	}
+	run->nr_pages = 0;
+	return ret;
+}
+
+/* дǰ, ҳΪӳٿ;  write_cache_pages һ,
+ * ദ nr_to_write ҳ, ѭдʱ writeback_index ƻصļͷ */
+static void hdd_da_map_pages(struct address_space *mapping,
+	struct writeback_control *wbc)
+{
+	struct inode *inode = mapping->host;
+	struct hdd_da_run *run;
+	struct pagevec pvec;
+	struct page *page;
+	pgoff_t index, end, start = 0;
+	long nr_to_write = wbc->nr_to_write;	/* λɴҳ */
+	int cycled = 1;				/* Ƿƻļͷ */
+	int i, nr, ret = 0;
+
+	if (wbc->sync_mode != WB_SYNC_NONE)
+		nr_to_write = LONG_MAX;		/* ͬдҳ */
+
+	if (wbc->range_cyclic) {
+		start = index = mapping->writeback_index;
+		cycled = !index;
+		end = -1;
+	} else {
+		index = wbc->range_start >> PAGE_CACHE_SHIFT;
+		end = wbc->range_end >> PAGE_CACHE_SHIFT;
+	}
+
+	run = kmalloc(sizeof(*run), GFP_NOFS);
+	if (!run)
+		return;		/*  writepage ҳ */
+
+	run->nr_pages = 0;
+	pagevec_init(&pvec, 0);
+retry:
+	while (!ret && index <= end && nr_to_write > 0) {
+		nr = pagevec_lookup_tag(&pvec, mapping, &index,
+				PAGECACHE_TAG_DIRTY,
+				min(end - index, (pgoff_t)PAGEVEC_SIZE - 1) + 1);
+		if (!nr)
+			break;
+
+		for (i = 0; i < nr; i++) {
+			page = pvec.pages[i];
+			if (page->index > end)
+				break;
+
+			/*  run ,  run , Ϊ run  */
+			if (run->nr_pages && (run->nr_pages == HDD_DA_MAX_PAGES ||
+			    page->index != run->pages[run->nr_pages-1]->index+1)) {
+				ret = hdd_da_map_run(inode, run);
+				if (ret)
+					break;
+			}
+
+			/* ҳŵ˳, ضһ */
+			lock_page(page);
+			if (page->mapping != mapping || !PageDirty(page)
+			|| !hdd_page_has_delay(page)) {
+				unlock_page(page);
+				continue;
+			}
+			page_cache_get(page);
+			run->pages[run->nr_pages++] = page;
+			if (--nr_to_write <= 0)
+				break;
+		}
+		pagevec_release(&pvec);
+		cond_resched();
+	}
+
+	/* ļβ, ͷ֮ǰ */
+	if (!ret && !cycled && nr_to_write > 0) {
+		cycled = 1;
+		index = 0;
+		end = start - 1;
+		goto retry;
+	}
+
+	if (run->nr_pages) {
+		i = hdd_da_map_run(inode, run);
+		if (!ret)
+			ret = i;
+	}
+
+	/* ʧܵҳ writepage ҳ */
+	if (ret)
+		hdd_msg(inode->i_sb, KERN_WARNING, "hdd_da_map_pages",
+			"delayed allocation failed for ino %lu, err %d",
+			inode->i_ino, ret);
+	kfree(run);
+}
+
+/* ӳٷ: дһҳ */
+static int hdd_da_writepage(struct page *page, struct writeback_control *wbc)
+{
+	return block_write_full_page(page, hdd_da_get_block_write, wbc);
+}
+
+/* ӳٷ: дҳ, ʱ෶Χ֪, ȳҳд */
+static int hdd_da_writepages(struct address_space *mapping,
+	struct writeback_control *wbc)
+{
+	if (!mapping->nrpages || !mapping_tagged(mapping, PAGECACHE_TAG_DIRTY))
+		return 0;
+
+	hdd_da_map_pages(mapping, wbc);
+
+	/* Ϊӳٿҳ hdd_da_writepage ҳ */
+	return hdd_mpage_writepages(mapping, wbc, hdd_da_get_block_write);
+}
+
+/* ӳٷ: дҳǰ׼ */
+static int hdd_da_write_begin(struct file *file, struct address_space *mapping,
+	loff_t pos, unsigned len, unsigned flags,
+	struct page **pagep, void **fsdata)
+{
+	*pagep = NULL;
+	return block_write_begin(file, mapping, pos, len, flags, pagep,
+		fsdata, hdd_da_get_block_prep);
+}
+
+/* ӳٷ: ҳضʱ, ͷӳٿԤ */
+static void hdd_da_invalidatepage(struct page *page, unsigned long offset)
+{
+	struct buffer_head *head, *bh;
+	unsigned int curr_off = 0;
+	int to_release = 0;
+
+	BUG_ON(!PageLocked(page));
+	if (!page_has_buffers(page))
+		goto out;
+
+	bh = head = page_buffers(page);
+	do {
+		if (offset <= curr_off && buffer_delay(bh)) {
+			to_release++;
+			clear_buffer_delay(bh);
+		}
+		curr_off += bh->b_size;
+	} while ((bh = bh->b_this_page) != head);
+
+	hdd_da_release_space(page->mapping->host, to_release);
+out:
+	block_invalidatepage(page, offset);
 }
 
 static sector_t hdd_bmap(struct address_space *mapping, sector_t block)
 {
+	/* ӳٿ黹ûп, д */
+	if (mapping_tagged(mapping, PAGECACHE_TAG_DIRTY)
+	&& test_opt(mapping->host->i_sb, DELALLOC))
+		filemap_write_and_wait(mapping);
+
 	return generic_block_bmap(mapping, block, hdd_get_block);
 }
 
@@ -1153,6 +2680,69 @@ int hdd_fiemap(struct inode *inode, struct fiemap_extent_info *fieinfo,
 		hdd_get_block);
 }
 
+/* Ϊ [offset, offset+len) Ԥ, ¿Ϊδд, Ϊ;
+ * FALLOC_FL_PUNCH_HOLE ʱͷŷΧڵĿ */
+long hdd_fallocate(struct inode *inode, int mode, loff_t offset, loff_t len)
+{
+	struct hdd_map_blocks map;
+	unsigned int blkbits = inode->i_blkbits;
+	sector_t block;
+	unsigned long max_blocks;
+	loff_t new_size;
+	int ret = 0;
+
+	if (!S_ISREG(inode->i_mode))
+		return -ENODEV;
+	if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE))
+		return -EOPNOTSUPP;
+
+	/* 򶴲ıļ */
+	if (mode & FALLOC_FL_PUNCH_HOLE) {
+		if (!(mode & FALLOC_FL_KEEP_SIZE))
+			return -EOPNOTSUPP;
+		mutex_lock(&inode->i_mutex);
+		down_write(&inode->i_alloc_sem);	/* ֱ I/O , ͬض */
+		ret = hdd_punch_hole(inode, offset, len);
+		up_write(&inode->i_alloc_sem);
+		mutex_unlock(&inode->i_mutex);
+		return ret;
+	}
+
+	block = offset >> blkbits;
+	max_blocks = ((offset + len + (1 << blkbits) - 1) >> blkbits) - block;
+
+	mutex_lock(&inode->i_mutex);
+	ret = inode_newsize_ok(inode, offset + len);
+	if (ret)
+		goto out;
+
+	while (max_blocks > 0) {
+		map.m_lblk = block;
+		map.m_len = max_blocks;
+		/* Ԥ䲻Ƿ, ȶ */
+		ret = hdd_map_blocks(inode, &map, HDD_GET_BLOCKS_PREALLOC |
+				     HDD_GET_BLOCKS_NOACCT);
+		if (ret <= 0) {
+			if (ret == 0)
+				ret = -EIO;
+			break;
+		}
+		block += ret;
+		max_blocks -= ret;
+		ret = 0;
+	}
+
+	/* ʱҲѷĲ */
+	new_size = min_t(loff_t, offset + len, (loff_t) block << blkbits);
+	if (!(mode & FALLOC_FL_KEEP_SIZE) && new_size > i_size_read(inode))
+		i_size_write(inode, new_size);
+	inode->i_ctime = CURRENT_TIME_SEC;
+	mark_inode_dirty(inode);
+out:
+	mutex_unlock(&inode->i_mutex);
+	return ret;
+}
+
 /* ļϵͳͿ */
 const struct address_space_operations hdd_aops = {
 	.readpage		= hdd_readpage,
@@ -1177,3 +2767,34 @@ const struct address_space_operations hdd_aops = {
 	.error_remove_page	= generic_error_remove_page,
 };
 
+/* ӳٷĳļ */
+const struct address_space_operations hdd_da_aops = {
+	.readpage		= hdd_readpage,
+	.readpages		= hdd_readpages,
+
+	.writepage		= hdd_da_writepage,
+	.writepages		= hdd_da_writepages,
+
+	.sync_page		= block_sync_page,
+
+	.write_begin		= hdd_da_write_begin,
+	.write_end		= generic_write_end,
+
+	.direct_IO		= hdd_direct_IO,
+	.bmap			= hdd_bmap,
+
+	.invalidatepage		= hdd_da_invalidatepage,
+
+	.is_partially_uptodate	= block_is_partially_uptodate,
+	.error_remove_page	= generic_error_remove_page,
+};
+
+/* óļ address_space  */
+void hdd_set_aops(struct inode *inode)
+{
+	if (test_opt(inode->i_sb, DELALLOC))
+		inode->i_mapping->a_ops = &hdd_da_aops;
+	else
+		inode->i_mapping->a_ops = &hdd_aops;
+}
+
@@ -0,0 +1,256 @@
+/*
+ * fmcfs/fmc_hdd/hdd_mcache.c
+ *
+ * Copyright (C) 2013 by Xuesen Liang, <liangxuesen@gmail.com>
+ * @ Beijing University of Posts and Telecommunications,
+ * @ CPU & SoC Center of Tsinghua University.
+ *
+ * This program can be redistributed under the terms of the GNU Public License.
+ */
+
+/*
+ * inode ӳ仺.
+ *
+ * ÿ inode ɶӳ: ߼ʼ, ʼ, 
+ * 豸(HDD/SSD). ʱ hdd_get_blocks ٶȡַ֤·.
+ * ֻдĿ; ضϺʹͷſ֮ǰ֮һ
+ * hdd_map_cache_invalidate, ǨƸıӳ. ·ӷΧ,
+ * ͷǰʧЧ֤᷵ͷŵĿ. ʧЧ֮ľ
+ * i_map_gen : ·ǰȡô, ʱѱ; ͷ
+ * ڼľӳͷźʧЧ. ʧЧʱͬʱ inode
+ * δдķ,  access.c.
+ *
+ * л inode ȫ, ڴʱ shrinker δõ
+ * inode ʼͷ.
+ */
+
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+
+#include "hdd.h"
+
+#define HDD_MAP_CACHE_MAX	16	/* ÿ inode ໺Ķ */
+
+struct hdd_map_entry {
+	struct list_head	me_list;	/*  i_map_list, õǰ */
+	unsigned long		me_lblk;	/* ߼ʼ */
+	unsigned int		me_pblk;	/* ʼ */
+	unsigned int		me_len;		/*  */
+	int			me_loc;		/* BLOCK_ON_SSD / BLOCK_ON_HDD */
+	int			me_boundary;	/* βǷΪһĽβ */
+	unsigned int		me_ablk;	/* һַ, ֱӿΪ 0 */
+	unsigned int		me_aidx;	/* ׿ַе± */
+};
+
+static struct kmem_cache *hdd_map_cachep;
+
+static LIST_HEAD(hdd_map_inodes);	/* л inode, ں */
+static DEFINE_SPINLOCK(hdd_map_inodes_lock);
+static atomic_t hdd_map_entries = ATOMIC_INIT(0);
+
+/* ͷ inode л, ߳ i_map_lock */
+static void map_cache_clear(struct hdd_inode_info *hi)
+{
+	struct hdd_map_entry *me, *tmp;
+
+	list_for_each_entry_safe(me, tmp, &hi->i_map_list, me_list) {
+		list_del(&me->me_list);
+		kmem_cache_free(hdd_map_cachep, me);
+	}
+	atomic_sub(hi->i_map_count, &hdd_map_entries);
+	hi->i_map_count = 0;
+}
+
+/* ȡõǰ, ڽ·ǰ */
+unsigned int hdd_map_cache_gen(struct inode *inode)
+{
+	struct hdd_inode_info *hi = HDD_I(inode);
+	unsigned int gen;
+
+	spin_lock(&hi->i_map_lock);
+	gen = hi->i_map_gen;
+	spin_unlock(&hi->i_map_lock);
+	return gen;
+}
+
+/*  lblk ӳ, ʱд, βĿ,  1;
+ * rec д¼ηĵַʹ */
+int hdd_map_cache_lookup(struct inode *inode, unsigned long lblk,
+	unsigned int *pblk, unsigned int *len, int *loc, int *boundary,
+	struct hdd_access_rec *rec)
+{
+	struct hdd_inode_info *hi = HDD_I(inode);
+	struct hdd_map_entry *me;
+
+	if (!hi->i_map_count)
+		return 0;
+
+	spin_lock(&hi->i_map_lock);
+	list_for_each_entry(me, &hi->i_map_list, me_list) {
+		if (lblk < me->me_lblk || lblk >= me->me_lblk + me->me_len)
+			continue;
+
+		*pblk = me->me_pblk + (lblk - me->me_lblk);
+		*len = me->me_len - (lblk - me->me_lblk);
+		*loc = me->me_loc;
+		*boundary = me->me_boundary;
+		rec->gen = hi->i_map_gen;
+		rec->ablk = me->me_ablk;
+		rec->aidx = me->me_aidx + (lblk - me->me_lblk);
+		list_move(&me->me_list, &hi->i_map_list);
+		spin_unlock(&hi->i_map_lock);
+		return 1;
+	}
+	spin_unlock(&hi->i_map_lock);
+	return 0;
+}
+
+/* һӳ; gen ΪǰȡõĴ, ֮ӳб򲻲 */
+void hdd_map_cache_insert(struct inode *inode, unsigned long lblk,
+	unsigned int pblk, unsigned int len, int loc, int boundary,
+	unsigned int ablk, unsigned int aidx, unsigned int gen)
+{
+	struct hdd_inode_info *hi = HDD_I(inode);
+	struct hdd_map_entry *me, *tmp;
+	struct hdd_map_entry *new;
+
+	new = kmem_cache_alloc(hdd_map_cachep, GFP_NOFS);
+	if (!new)
+		return;
+
+	new->me_lblk = lblk;
+	new->me_pblk = pblk;
+	new->me_len = len;
+	new->me_loc = loc;
+	new->me_boundary = boundary;
+	new->me_ablk = ablk;
+	new->me_aidx = aidx;
+
+	spin_lock(&hi->i_map_lock);
+	if (hi->i_map_gen != gen)
+		goto drop;
+
+	/* ȥ¶صľɶ */
+	list_for_each_entry_safe(me, tmp, &hi->i_map_list, me_list) {
+		if (me->me_lblk >= lblk + len || lblk >= me->me_lblk + me->me_len)
+			continue;
+		list_del(&me->me_list);
+		kmem_cache_free(hdd_map_cachep, me);
+		hi->i_map_count--;
+		atomic_dec(&hdd_map_entries);
+	}
+
+	/* δõһ */
+	if (hi->i_map_count >= HDD_MAP_CACHE_MAX) {
+		me = list_entry(hi->i_map_list.prev,
+				struct hdd_map_entry, me_list);
+		list_del(&me->me_list);
+		kmem_cache_free(hdd_map_cachep, me);
+		hi->i_map_count--;
+		atomic_dec(&hdd_map_entries);
+	}
+
+	list_add(&new->me_list, &hi->i_map_list);
+	hi->i_map_count++;
+	atomic_inc(&hdd_map_entries);
+
+	/* ʱҵȫ,  shrinker  */
+	if (list_empty(&hi->i_map_lru)) {
+		spin_lock(&hdd_map_inodes_lock);
+		list_add_tail(&hi->i_map_lru, &hdd_map_inodes);
+		spin_unlock(&hdd_map_inodes_lock);
+	}
+	spin_unlock(&hi->i_map_lock);
+	return;
+
+drop:
+	spin_unlock(&hi->i_map_lock);
+	kmem_cache_free(hdd_map_cachep, new);
+}
+
+/* ʹ߼ [start, end) ӳʧЧ, ͷſ֮ǰ޸ĵַ֮;
+ * ַͷ, inode ķһ */
+void hdd_map_cache_invalidate(struct inode *inode, unsigned long start,
+	unsigned long end)
+{
+	struct hdd_inode_info *hi = HDD_I(inode);
+	struct hdd_map_entry *me, *tmp;
+
+	spin_lock(&hi->i_map_lock);
+	hi->i_map_gen++;
+	list_for_each_entry_safe(me, tmp, &hi->i_map_list, me_list) {
+		if (me->me_lblk >= end || start >= me->me_lblk + me->me_len)
+			continue;
+		list_del(&me->me_list);
+		kmem_cache_free(hdd_map_cachep, me);
+		hi->i_map_count--;
+		atomic_dec(&hdd_map_entries);
+	}
+	hdd_access_clear(inode);
+	spin_unlock(&hi->i_map_lock);
+}
+
+/* ͷ inode ʱл */
+void hdd_map_cache_drop(struct inode *inode)
+{
+	struct hdd_inode_info *hi = HDD_I(inode);
+
+	spin_lock(&hi->i_map_lock);
+	map_cache_clear(hi);
+	if (!list_empty(&hi->i_map_lru)) {
+		spin_lock(&hdd_map_inodes_lock);
+		list_del_init(&hi->i_map_lru);
+		spin_unlock(&hdd_map_inodes_lock);
+	}
+	spin_unlock(&hi->i_map_lock);
+}
+
+/* ڴʱ inode ʼͷŻ, ʣ */
+static int hdd_map_cache_shrink(int nr_to_scan, gfp_t gfp_mask)
+{
+	struct hdd_inode_info *hi, *tmp;
+
+	if (nr_to_scan) {
+		spin_lock(&hdd_map_inodes_lock);
+		list_for_each_entry_safe(hi, tmp, &hdd_map_inodes, i_map_lru) {
+			if (nr_to_scan <= 0)
+				break;
+			/* ˳෴, ȡ */
+			if (!spin_trylock(&hi->i_map_lock))
+				continue;
+			nr_to_scan -= hi->i_map_count;
+			map_cache_clear(hi);
+			list_del_init(&hi->i_map_lru);
+			spin_unlock(&hi->i_map_lock);
+		}
+		spin_unlock(&hdd_map_inodes_lock);
+	}
+
+	return (atomic_read(&hdd_map_entries) / 100) * sysctl_vfs_cache_pressure;
+}
+
+static struct shrinker hdd_map_shrinker = {
+	.shrink = hdd_map_cache_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+/* ӳ仺, ģʱ */
+int hdd_init_map_cache(void)
+{
+	hdd_map_cachep = kmem_cache_create("hdd_map_cache",
+				sizeof(struct hdd_map_entry), 0,
+				SLAB_RECLAIM_ACCOUNT, NULL);
+	if (!hdd_map_cachep)
+		return -ENOMEM;
+
+	register_shrinker(&hdd_map_shrinker);
+	return 0;
+}
+
+/* ӳ仺, ģжʱ */
+void hdd_destroy_map_cache(void)
+{
+	unregister_shrinker(&hdd_map_shrinker);
+	kmem_cache_destroy(hdd_map_cachep);
+}
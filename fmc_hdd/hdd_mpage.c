@@ -0,0 +1,460 @@
+/*
+ * fmcfs/fmc_hdd/hdd_mpage.c
+ *
+ * Copyright (C) 2013 by Xuesen Liang, <liangxuesen@gmail.com>
+ * @ Beijing University of Posts and Telecommunications,
+ * @ CPU & SoC Center of Tsinghua University.
+ *
+ * This program can be redistributed under the terms of the GNU Public License.
+ */
+
+/*
+ * 豸Ķҳд.
+ *
+ * mpage_readpages ֻжҳܷ뵱ǰ bio, Ƚ豸, 
+ * ǨƵ SSD ļܰ SSD ϵҳ뷢 HDD  bio. Ԥ
+ * ҳȡӳ, 豸ͬҳͬһ bio, 豸λ
+ * ıʱύǰ bio, һ. һӳֻһ hdd_map_blocks.
+ *
+ * Ҫ鳤ҳ; Ѵлͷӳҳ block_read_full_page.
+ *
+ * дͬ豸ۼ: ҳĿѷ(ӳٷʱ hdd_da_map_pages ɶ
+ * )ʱ, 豸ͬҳͬһ bio, ʹд HDD 
+ * γɴ˳д. δ, ӳٿ, ļβ writepage 
+ * ҳ·.
+ *
+ * ֲԤ: ÿλ֮ǰ, λϵĿ豸ѡԤ, 
+ * Ԥ״̬ľֲԤ. HDD ô󴰿ڷ̯Ѱ, SSD С, 
+ * . ڴСɹѡ ra_hdd, ra_ssd , 豸Ĭ
+ * ڵļõֵ; posix_fadvise ȸıڵļͬı.
+ * ļԼĴڲ޸. ͳƼ /proc/fs/fmc_hdd/<豸>/ra_stats.
+ */
+
+#include <linux/fs.h>
+#include <linux/bio.h>
+#include <linux/mm.h>
+#include <linux/math64.h>
+#include <linux/backing-dev.h>
+#include <linux/pagemap.h>
+#include <linux/buffer_head.h>
+#include <linux/mpage.h>
+#include <linux/writeback.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+
+#include "hdd.h"
+
+static struct proc_dir_entry *hdd_proc_root;	/* /proc/fs/fmc_hdd */
+
+/* bio Ĳ */
+static inline int hdd_bio_tier(struct super_block *sb, struct bio *bio)
+{
+	return bio->bi_bdev == sb->s_bdev ? BLOCK_ON_HDD : BLOCK_ON_SSD;
+}
+
+struct hdd_mpage_read {
+	struct super_block	*sb;
+	struct bio		*bio;		/* װ bio */
+	sector_t		next_pblk;	/* bio һҳӦе */
+	struct hdd_map_blocks	map;		/* һӳ, m_len Ϊ 0 ʾЧ */
+};
+
+static void hdd_mpage_end_io(struct bio *bio, int err)
+{
+	const int uptodate = test_bit(BIO_UPTODATE, &bio->bi_flags);
+	struct bio_vec *bvec;
+	int i;
+
+	bio_for_each_segment(bvec, bio, i) {
+		struct page *page = bvec->bv_page;
+
+		if (uptodate) {
+			SetPageUptodate(page);
+		} else {
+			ClearPageUptodate(page);
+			SetPageError(page);
+		}
+		unlock_page(page);
+	}
+	bio_put(bio);
+}
+
+static void hdd_mpage_submit(struct hdd_mpage_read *mr)
+{
+	struct hdd_sb_info *sbi;
+	int tier;
+
+	if (mr->bio) {
+		sbi = HDD_SB(mr->sb);
+		tier = hdd_bio_tier(mr->sb, mr->bio);
+		percpu_counter_inc(&sbi->s_ra_bios[tier]);
+		percpu_counter_add(&sbi->s_ra_read_pages[tier],
+				   mr->bio->bi_vcnt);
+		submit_bio(READ, mr->bio);
+		mr->bio = NULL;
+	}
+}
+
+/* һҳ; nr_left ΪҳڻҪҳ, ȷӳ bio ĳ */
+static void hdd_mpage_readpage(struct hdd_mpage_read *mr, struct page *page,
+	unsigned long nr_left)
+{
+	struct inode *inode = page->mapping->host;
+	unsigned blkbits = inode->i_blkbits;
+	sector_t iblock = page->index;
+	sector_t last_block;
+	sector_t pblk;
+	int nr_vecs;
+
+	if (page_has_buffers(page))
+		goto confused;
+
+	/* ļβ֮ҳΪ */
+	last_block = (i_size_read(inode) + PAGE_SIZE - 1) >> blkbits;
+	if (iblock >= last_block)
+		goto hole;
+
+	/* һӳ, ȡӳ */
+	if (!mr->map.m_len || iblock < mr->map.m_lblk
+	|| iblock >= mr->map.m_lblk + mr->map.m_len) {
+		mr->map.m_lblk = iblock;
+		mr->map.m_len = min_t(sector_t, nr_left, last_block - iblock);
+		if (hdd_map_blocks(inode, &mr->map, 0) < 0) {
+			mr->map.m_len = 0;
+			goto confused;
+		}
+	}
+	if (!(mr->map.m_flags & HDD_MAP_MAPPED))
+		goto hole;
+
+	pblk = mr->map.m_pblk + (iblock - mr->map.m_lblk);
+
+	/* 豸ͬ鲻, ύǰ bio */
+	if (mr->bio && (mr->bio->bi_bdev != mr->map.m_bdev
+			|| mr->next_pblk != pblk))
+		hdd_mpage_submit(mr);
+
+alloc:
+	if (!mr->bio) {
+		nr_vecs = min_t(unsigned long, nr_left,
+				bio_get_nr_vecs(mr->map.m_bdev));
+		mr->bio = bio_alloc(GFP_NOFS, nr_vecs);
+		mr->bio->bi_bdev = mr->map.m_bdev;
+		mr->bio->bi_sector = pblk << (blkbits - 9);
+		mr->bio->bi_end_io = hdd_mpage_end_io;
+	}
+	if (bio_add_page(mr->bio, page, PAGE_SIZE, 0) < PAGE_SIZE) {
+		if (!mr->bio->bi_vcnt) {
+			bio_put(mr->bio);
+			mr->bio = NULL;
+			goto confused;
+		}
+		hdd_mpage_submit(mr);
+		goto alloc;
+	}
+	mr->next_pblk = pblk + 1;
+
+	/* ӳε˵ַ߽, ҪԪ, ύ */
+	if ((mr->map.m_flags & HDD_MAP_BOUNDARY)
+	&& iblock == mr->map.m_lblk + mr->map.m_len - 1)
+		hdd_mpage_submit(mr);
+	return;
+
+hole:
+	zero_user(page, 0, PAGE_SIZE);
+	SetPageUptodate(page);
+	unlock_page(page);
+	return;
+
+confused:
+	hdd_mpage_submit(mr);
+	if (!PageUptodate(page))
+		block_read_full_page(page, hdd_get_block);
+	else
+		unlock_page(page);
+}
+
+/* дʱװ bio */
+struct hdd_mpage_write {
+	struct bio		*bio;
+	sector_t		next_pblk;	/* bio һҳӦе */
+	get_block_t		*get_block;	/* ҳ·ʹ */
+};
+
+static void hdd_mpage_write_end_io(struct bio *bio, int err)
+{
+	const int uptodate = test_bit(BIO_UPTODATE, &bio->bi_flags);
+	struct bio_vec *bvec;
+	int i;
+
+	bio_for_each_segment(bvec, bio, i) {
+		struct page *page = bvec->bv_page;
+
+		if (!uptodate) {
+			SetPageError(page);
+			if (page->mapping)
+				set_bit(AS_EIO, &page->mapping->flags);
+		}
+		end_page_writeback(page);
+	}
+	bio_put(bio);
+}
+
+static void hdd_mpage_write_submit(struct hdd_mpage_write *mw)
+{
+	if (mw->bio) {
+		submit_bio(WRITE, mw->bio);
+		mw->bio = NULL;
+	}
+}
+
+/* write_cache_pages Ļص: ҳѼ,  */
+static int hdd_mpage_writepage(struct page *page, struct writeback_control *wbc,
+	void *data)
+{
+	struct hdd_mpage_write *mw = data;
+	struct address_space *mapping = page->mapping;
+	struct inode *inode = mapping->host;
+	unsigned blkbits = inode->i_blkbits;
+	pgoff_t end_index = i_size_read(inode) >> PAGE_CACHE_SHIFT;
+	struct buffer_head *bh;
+	sector_t pblk;
+	int ret;
+
+	/* ֻҳļ, ӳЧҳ */
+	if (page->index >= end_index || !page_has_buffers(page))
+		goto confused;
+	bh = page_buffers(page);
+	if (!buffer_mapped(bh) || buffer_delay(bh) || buffer_unwritten(bh)
+	|| !buffer_dirty(bh) || !buffer_uptodate(bh))
+		goto confused;
+
+	pblk = bh->b_blocknr;
+
+	/* 豸ͬ鲻, ύǰ bio */
+	if (mw->bio && (mw->bio->bi_bdev != bh->b_bdev
+			|| mw->next_pblk != pblk))
+		hdd_mpage_write_submit(mw);
+
+alloc:
+	if (!mw->bio) {
+		mw->bio = bio_alloc(GFP_NOFS, bio_get_nr_vecs(bh->b_bdev));
+		mw->bio->bi_bdev = bh->b_bdev;
+		mw->bio->bi_sector = pblk << (blkbits - 9);
+		mw->bio->bi_end_io = hdd_mpage_write_end_io;
+	}
+	if (bio_add_page(mw->bio, page, PAGE_SIZE, 0) < PAGE_SIZE) {
+		if (!mw->bio->bi_vcnt) {
+			bio_put(mw->bio);
+			mw->bio = NULL;
+			goto confused;
+		}
+		hdd_mpage_write_submit(mw);
+		goto alloc;
+	}
+	mw->next_pblk = pblk + 1;
+
+	clear_buffer_dirty(bh);
+	BUG_ON(PageWriteback(page));
+	set_page_writeback(page);
+	unlock_page(page);
+
+	/* ǵַ, ύ */
+	if (buffer_boundary(bh))
+		hdd_mpage_write_submit(mw);
+	return 0;
+
+confused:
+	hdd_mpage_write_submit(mw);
+	ret = block_write_full_page(page, mw->get_block, wbc);
+	mapping_set_error(mapping, ret);
+	return ret;
+}
+
+/* дҳ, 豸λþۼɴ bio */
+int hdd_mpage_writepages(struct address_space *mapping,
+	struct writeback_control *wbc, get_block_t get_block)
+{
+	struct hdd_mpage_write mw;
+	int ret;
+
+	if (mapping->host->i_blkbits != PAGE_SHIFT)
+		return mpage_writepages(mapping, wbc, get_block);
+
+	mw.bio = NULL;
+	mw.next_pblk = 0;
+	mw.get_block = get_block;
+
+	ret = write_cache_pages(mapping, wbc, hdd_mpage_writepage, &mw);
+	hdd_mpage_write_submit(&mw);
+	return ret;
+}
+
+/* Ԥ: pages еҳ±, δҳ */
+int hdd_mpage_readpages(struct address_space *mapping,
+	struct list_head *pages, unsigned nr_pages)
+{
+	struct hdd_mpage_read mr;
+	struct page *page;
+	unsigned i;
+
+	if (mapping->host->i_blkbits != PAGE_SHIFT)
+		return mpage_readpages(mapping, pages, nr_pages, hdd_get_block);
+
+	mr.sb = mapping->host->i_sb;
+	mr.bio = NULL;
+	mr.next_pblk = 0;
+	mr.map.m_len = 0;
+
+	for (i = 0; i < nr_pages; i++) {
+		page = list_entry(pages->prev, struct page, lru);
+		list_del(&page->lru);
+		if (!add_to_page_cache_lru(page, mapping,
+					   page->index, GFP_KERNEL))
+			hdd_mpage_readpage(&mr, page, nr_pages - i);
+		page_cache_release(page);
+	}
+	BUG_ON(!list_empty(pages));
+
+	hdd_mpage_submit(&mr);
+	return 0;
+}
+
+/*  pos Ŀ豸Ԥ, Ϊ [pos, pos+count) Ԥ, ڻ
+ * ֮ǰ. f_ra ʹͬһ file ̹߳, ֻھֲ,
+ * ԤֻдλúʹС, ͨö·һ; ļԼ ra_pages
+ * . Ԥาһ, Ĳͨö·ļĴԤ */
+void hdd_ra_prepare(struct file *filp, loff_t pos, size_t count)
+{
+	struct address_space *mapping = filp->f_mapping;
+	struct inode *inode = mapping->host;
+	struct hdd_sb_info *sbi = HDD_SB(inode->i_sb);
+	unsigned long bdi_pages = mapping->backing_dev_info->ra_pages;
+	loff_t size = i_size_read(inode);
+	struct file_ra_state ra;
+	struct hdd_map_blocks map;
+	struct page *page;
+	pgoff_t index, last;
+	int tier;
+
+	if (pos >= size || !count || !bdi_pages)
+		return;
+
+	/* ֻѡ񴰿, ַ鲻ڴʱΪ˶豸, ԭ;
+	   ⲻķ, ȶ */
+	map.m_lblk = pos >> inode->i_blkbits;
+	map.m_len = 1;
+	if (hdd_map_blocks(inode, &map,
+			   HDD_GET_BLOCKS_NOWAIT | HDD_GET_BLOCKS_NOACCT) <= 0)
+		return;		/* նԭ */
+
+	tier = map.m_bdev == inode->i_sb->s_bdev ? BLOCK_ON_HDD : BLOCK_ON_SSD;
+	ra = filp->f_ra;
+	ra.ra_pages = div_u64((u64) ra.ra_pages * sbi->s_ra_pages[tier],
+			      bdi_pages);
+	if (!ra.ra_pages)
+		return;
+
+	if (count > size - pos)
+		count = size - pos;
+	index = pos >> PAGE_CACHE_SHIFT;
+	last = (pos + count - 1) >> PAGE_CACHE_SHIFT;
+	if (last - index >= ra.ra_pages)
+		last = index + ra.ra_pages - 1;
+
+	/*  do_generic_file_read ͬʱ: ȱҳͬԤ, Ԥ
+	   첽Ԥ */
+	for (; index <= last; index++) {
+		page = find_get_page(mapping, index);
+		if (!page) {
+			page_cache_sync_readahead(mapping, &ra, filp, index,
+						  last + 1 - index);
+			continue;
+		}
+		if (PageReadahead(page))
+			page_cache_async_readahead(mapping, &ra, filp, page,
+						   index, last + 1 - index);
+		page_cache_release(page);
+	}
+
+	filp->f_ra.start = ra.start;
+	filp->f_ra.size = ra.size;
+	filp->f_ra.async_size = ra.async_size;
+	percpu_counter_inc(&sbi->s_ra_reads[tier]);
+}
+
+static int hdd_ra_stats_show(struct seq_file *seq, void *v)
+{
+	struct super_block *sb = seq->private;
+	struct hdd_sb_info *sbi = HDD_SB(sb);
+	static const char *names[2] = { "hdd", "ssd" };
+	int tier;
+
+	seq_printf(seq, "tier window_pages reads ra_pages ra_bios\n");
+	for (tier = BLOCK_ON_HDD; tier <= BLOCK_ON_SSD; tier++)
+		seq_printf(seq, "%s %u %lld %lld %lld\n", names[tier],
+			sbi->s_ra_pages[tier],
+			percpu_counter_sum_positive(&sbi->s_ra_reads[tier]),
+			percpu_counter_sum_positive(&sbi->s_ra_read_pages[tier]),
+			percpu_counter_sum_positive(&sbi->s_ra_bios[tier]));
+	return 0;
+}
+
+static int hdd_ra_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, hdd_ra_stats_show, PDE(inode)->data);
+}
+
+static const struct file_operations hdd_ra_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= hdd_ra_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/* ʱ /proc/fs/fmc_hdd/<豸>/ra_stats */
+int hdd_ra_proc_register(struct super_block *sb)
+{
+	struct hdd_sb_info *sbi = HDD_SB(sb);
+
+	if (!hdd_proc_root)
+		return -ENOENT;
+
+	sbi->s_proc = proc_mkdir(sb->s_id, hdd_proc_root);
+	if (!sbi->s_proc)
+		return -ENOMEM;
+
+	if (!proc_create_data("ra_stats", S_IRUGO, sbi->s_proc,
+			      &hdd_ra_stats_fops, sb)) {
+		remove_proc_entry(sb->s_id, hdd_proc_root);
+		sbi->s_proc = NULL;
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+void hdd_ra_proc_unregister(struct super_block *sb)
+{
+	struct hdd_sb_info *sbi = HDD_SB(sb);
+
+	if (!sbi->s_proc)
+		return;
+
+	remove_proc_entry("ra_stats", sbi->s_proc);
+	remove_proc_entry(sb->s_id, hdd_proc_root);
+	sbi->s_proc = NULL;
+}
+
+/* ģʱ /proc/fs/fmc_hdd, ʧʱֻûͳ */
+int hdd_init_ra_proc(void)
+{
+	hdd_proc_root = proc_mkdir("fs/fmc_hdd", NULL);
+	return 0;
+}
+
+void hdd_destroy_ra_proc(void)
+{
+	if (hdd_proc_root)
+		remove_proc_entry("fs/fmc_hdd", NULL);
+}
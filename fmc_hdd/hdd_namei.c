@@ -87,7 +87,7 @@ static int hdd_create(struct inode * dir, struct dentry * dentry,
 	int err = PTR_ERR(inode);
 	if (!IS_ERR(inode)) {   /* ¼ 3  */
 		inode->i_op = &hdd_file_inode_operations; 
-		inode->i_mapping->a_ops = &hdd_aops;
+		hdd_set_aops(inode);
 		inode->i_fop = &hdd_file_operations;
 		mark_inode_dirty(inode);
 
@@ -0,0 +1,202 @@
+/*
+ * fmcfs/fmc_hdd/hdd_promote.c
+ *
+ * Copyright (C) 2013 by Xuesen Liang, <liangxuesen@gmail.com>
+ * @ Beijing University of Posts and Telecommunications,
+ * @ CPU & SoC Center of Tsinghua University.
+ *
+ * This program can be redistributed under the terms of the GNU Public License.
+ */
+
+/*
+ * ݿ SSD ׼ж.
+ *
+ * HDD ϵĿȶȳʱΪѡ. ȶΪķʼ;  sketch
+ * ʱΪֵ,  sketch ԼޱȽ( sketch.c).  blks_per_lvl ļ
+ * ֲó: ߼ۼƿ, ڽĿǡװ SSD 
+ * õĿ( SSD ϵĿ,  SSD п s_promote_ratio%),
+ * SSD ϱĴ¾ȵЩ. ʼıʱ hdd_promote_move
+ * ڽĿ s_promote_above; д
+ * hdd_promote_update ֻѽƶ, ʹ s_promote_above 
+ * ÿ, ÿۼֲ. ƽԪʱֲ, ߼
+ * ۼ.
+ *
+ * ˳(ҹ䱸)
+ * ÿ鶼, ȫ SSD ,  HDD 
+ * ó˳. ˰ hdd_get_blocks ߼Ϊÿļ
+ * ˳: βҽϴ֮( HDD_SEQ_GAP ļ϶)ʱӳ,
+ * ¿ʼ; ﵽ s_seq_cutoff , еĿ鲻.
+ *
+ * ״̬, ͬһļʱһ, ֻӰͳƺһж.
+ * жϽ /proc/fs/fmc_hdd/<豸>/promote_stats.
+ */
+
+#include <linux/fs.h>
+#include <linux/math64.h>
+#include <linux/proc_fs.h>
+#include <linux/rwsem.h>
+#include <linux/seq_file.h>
+
+#include "hdd.h"
+
+#define HDD_SEQ_GAP	8	/* ˳Ŀ */
+
+/* ļ˳,  [iblock, iblock + count) Ƿڳ˳ */
+static int promote_sequential(struct inode *inode, sector_t iblock,
+	unsigned int count)
+{
+	struct hdd_inode_info *hi = HDD_I(inode);
+	unsigned long next = hi->i_seq_next;
+	unsigned int cutoff = HDD_SB(inode->i_sb)->s_seq_cutoff;
+
+	if (iblock + HDD_SEQ_GAP >= next && iblock <= next + HDD_SEQ_GAP) {
+		/* ظβ֮ǰĿʱ䳤 */
+		if (iblock + count > next) {
+			hi->i_seq_len += iblock + count - next;
+			hi->i_seq_next = iblock + count;
+		}
+	} else {
+		hi->i_seq_len = count;
+		hi->i_seq_next = iblock + count;
+	}
+
+	return cutoff && hi->i_seq_len >= cutoff;
+}
+
+/*
+ * дһβ: ȶΪ heat ĿǷӦ SSD. heat 
+ * sketch ʱΪֵ, Ϊʼ.
+ * Ϊ hdd_get_blocks, Ҳķ, .
+ */
+int hdd_promote_admit(struct inode *inode, sector_t iblock,
+	unsigned int count, int location, unsigned int heat)
+{
+	struct hdd_sb_info *sbi = HDD_SB(inode->i_sb);
+	int sequential = promote_sequential(inode, iblock, count);
+	unsigned int level = sbi->s_sketch ? sbi->s_sketch_level :
+					     sbi->s_promote_level;
+
+	if (location != BLOCK_ON_HDD || heat <= level)
+		return 0;
+
+	if (sequential) {
+		percpu_counter_inc(&sbi->s_promote_seq);
+		return 0;
+	}
+	percpu_counter_inc(&sbi->s_promote_admit);
+	return 1;
+}
+
+/* SSD ϿɹȿʹõĿ */
+static s64 promote_budget(struct hdd_sb_info *sbi)
+{
+	s64 budget = 0;
+
+	mutex_lock(&sbi->ssd_mutex);
+	if (sbi->ssd_info) {
+		budget = percpu_counter_read_positive(
+			&sbi->ssd_info->s_freeblocks_counter);
+		budget = div_u64(budget * sbi->s_promote_ratio, 100);
+		budget += percpu_counter_read_positive(&sbi->ssd_blks_count);
+	}
+	mutex_unlock(&sbi->ssd_mutex);
+	return budget;
+}
+
+/* ƶ, ʹĿÿ, ٵһͳ;
+ * ߳ s_heat_sem д */
+static void promote_adjust(struct hdd_sb_info *sbi, s64 budget)
+{
+	unsigned int lvl = sbi->s_promote_level;
+	s64 above = percpu_counter_sum(&sbi->s_promote_above);
+	s64 count;
+
+	while (above > budget && lvl < FMC_MAX_LEVELS - 1) {
+		lvl++;
+		above -= percpu_counter_sum_positive(&sbi->blks_per_lvl[lvl]);
+	}
+	while (lvl > 0) {	/*  0 ĿӲ */
+		count = percpu_counter_sum_positive(&sbi->blks_per_lvl[lvl]);
+		if (above + count > budget)
+			break;
+		above += count;
+		lvl--;
+	}
+
+	sbi->s_promote_level = lvl;
+	percpu_counter_set(&sbi->s_promote_above, above);
+}
+
+/* ֲı, ߼ۼ; ߳ s_heat_sem д */
+void hdd_promote_reset(struct hdd_sb_info *sbi)
+{
+	sbi->s_promote_level = FMC_MAX_LEVELS - 1;
+	percpu_counter_set(&sbi->s_promote_above, 0);
+	promote_adjust(sbi, promote_budget(sbi));
+}
+
+/* ֲ SSD п, д */
+void hdd_promote_update(struct super_block *sb)
+{
+	struct hdd_sb_info *sbi = HDD_SB(sb);
+	s64 budget = promote_budget(sbi);
+
+	down_write(&sbi->s_heat_sem);
+	promote_adjust(sbi, budget);
+	up_write(&sbi->s_heat_sem);
+
+	hdd_sketch_update_level(sbi, budget);
+}
+
+static int hdd_promote_stats_show(struct seq_file *seq, void *v)
+{
+	struct super_block *sb = seq->private;
+	struct hdd_sb_info *sbi = HDD_SB(sb);
+
+	seq_printf(seq, "promote_level %u\n", sbi->s_promote_level);
+	if (sbi->s_sketch)
+		seq_printf(seq, "sketch_level %u\n", sbi->s_sketch_level);
+	seq_printf(seq, "promote_ratio %u\n", sbi->s_promote_ratio);
+	seq_printf(seq, "blocks_above %lld\n",
+		   percpu_counter_sum_positive(&sbi->s_promote_above));
+	seq_printf(seq, "seq_cutoff %u\n", sbi->s_seq_cutoff);
+	seq_printf(seq, "admitted %lld\n",
+		   percpu_counter_sum_positive(&sbi->s_promote_admit));
+	seq_printf(seq, "rejected_sequential %lld\n",
+		   percpu_counter_sum_positive(&sbi->s_promote_seq));
+	return 0;
+}
+
+static int hdd_promote_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, hdd_promote_stats_show, PDE(inode)->data);
+}
+
+static const struct file_operations hdd_promote_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= hdd_promote_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/*  /proc/fs/fmc_hdd/<豸> ½ promote_stats, Ԥͳ֮ */
+int hdd_promote_proc_register(struct super_block *sb)
+{
+	struct hdd_sb_info *sbi = HDD_SB(sb);
+
+	if (!sbi->s_proc)
+		return -ENOENT;
+	if (!proc_create_data("promote_stats", S_IRUGO, sbi->s_proc,
+			      &hdd_promote_stats_fops, sb))
+		return -ENOMEM;
+	return 0;
+}
+
+void hdd_promote_proc_unregister(struct super_block *sb)
+{
+	struct hdd_sb_info *sbi = HDD_SB(sb);
+
+	if (sbi->s_proc)
+		remove_proc_entry("promote_stats", sbi->s_proc);
+}
@@ -0,0 +1,193 @@
+/*
+ * fmcfs/fmc_hdd/hdd_sketch.c
+ *
+ * Copyright (C) 2013 by Xuesen Liang, <liangxuesen@gmail.com>
+ * @ Beijing University of Posts and Telecommunications,
+ * @ CPU & SoC Center of Tsinghua University.
+ *
+ * This program can be redistributed under the terms of the GNU Public License.
+ */
+
+/*
+ * ݿȶȵ count-min sketch.
+ *
+ * ȷÿҪôд HDD ϵĵַ, ҪôΪռôڴ. sketch
+ *  HDD_SKETCH_DEPTH мÿ (inode, ߼) ķʴ, ڴ
+ * ɹѡ heat_sketch= ָ, ڼ䲻. ֵֻƫ: ȡ
+ * ӦСֵ. ʱֻӵСֵļ(ظ), 
+ * ɵƫ.
+ *
+ * Ϊ 8 λ,  255. ÿ HDD_SKETCH_WINDOW пη, ȫ
+ * , ֵӳڵķ. Ҫɨ sketch, ̨߳.
+ *
+ * ĸ², ʱżʧһ, ԹʵӰ.
+ * ֵ뾫ȷıȽϼ fmc_tools/bench_sketch.c.
+ *
+ * ֵʼ˥ڲͬ, Ƚ.  sketch ʱ
+ *  s_sketch_level ɵһмķֲó: пԶȿʱ,
+ * һ¶Ӧһ, ȡʹ޵ļ SSD ÿ
+ * ֵ,  hdd_promote_update ͬʱ.
+ */
+
+#include <linux/fs.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+#include "hdd.h"
+
+#define HDD_SKETCH_DEPTH	4		/*  */
+#define HDD_SKETCH_WINDOW	8		/* ÿ 8 пηʼһ */
+#define HDD_SKETCH_MAX		255		/* ֵ */
+
+struct hdd_sketch {
+	unsigned int	sk_mask;		/* п - 1, пΪ 2  */
+	unsigned int	sk_seed[2];		/* ɢе */
+	unsigned int	sk_window;		/*  - ʴ */
+	atomic_t	sk_adds;		/* ϴμķ */
+	size_t		sk_size;		/* ֽ */
+	__u8		*sk_rows;		/* HDD_SKETCH_DEPTH м */
+};
+
+/* ڸеļ, ɢϵõ */
+static void sketch_slots(struct hdd_sketch *sk, struct inode *inode,
+	sector_t lblk, __u8 **slot)
+{
+	u32 h1 = jhash_2words(inode->i_ino, lblk, sk->sk_seed[0]);
+	u32 h2 = jhash_2words(inode->i_ino, lblk, sk->sk_seed[1]);
+	int i;
+
+	for (i = 0; i < HDD_SKETCH_DEPTH; i++)
+		slot[i] = sk->sk_rows + i * (sk->sk_mask + 1) +
+			((h1 + i * h2) & sk->sk_mask);
+}
+
+/* ȫ, ִ */
+static void sketch_halve(struct hdd_sketch *sk)
+{
+	unsigned long *w = (unsigned long *) sk->sk_rows;
+	size_t i, n = sk->sk_size / sizeof(unsigned long);
+
+	for (i = 0; i < n; i++) {
+		w[i] = (w[i] >> 1) & (~0UL / 0xff * 0x7f);
+		if (!(i & 4095))
+			cond_resched();
+	}
+}
+
+/*  lblk һη, ʴĹֵ; δʱ 0 */
+unsigned int hdd_sketch_add(struct inode *inode, sector_t lblk)
+{
+	struct hdd_sb_info *sbi = HDD_SB(inode->i_sb);
+	struct hdd_sketch *sk = sbi->s_sketch;
+	__u8 *slot[HDD_SKETCH_DEPTH];
+	unsigned int min = HDD_SKETCH_MAX;
+	int i;
+
+	if (!sk)
+		return 0;
+
+	sketch_slots(sk, inode, lblk, slot);
+	for (i = 0; i < HDD_SKETCH_DEPTH; i++)
+		min = min_t(unsigned int, min, *slot[i]);
+	if (min < HDD_SKETCH_MAX) {
+		for (i = 0; i < HDD_SKETCH_DEPTH; i++)
+			if (*slot[i] == min)
+				*slot[i] = min + 1;
+		min++;
+	}
+
+	/* ֻûк̨߳, ͵ؼ */
+	if (atomic_inc_return(&sk->sk_adds) == sk->sk_window) {
+		if (sbi->s_reclaim_task)
+			wake_up_process(sbi->s_reclaim_task);
+		else
+			hdd_sketch_age(sbi);
+	}
+	return min;
+}
+
+/* ﵽʱѼ, ɺ̵̨߳ */
+void hdd_sketch_age(struct hdd_sb_info *sbi)
+{
+	struct hdd_sketch *sk = sbi->s_sketch;
+
+	if (!sk || atomic_read(&sk->sk_adds) < sk->sk_window)
+		return;
+
+	atomic_sub(sk->sk_window, &sk->sk_adds);
+	sketch_halve(sk);
+}
+
+/* ɵһмķֲ½, ޵ļ budget ;
+ * ɺ̨߳д */
+void hdd_sketch_update_level(struct hdd_sb_info *sbi, s64 budget)
+{
+	struct hdd_sketch *sk = sbi->s_sketch;
+	unsigned int *hist;
+	unsigned int i, lvl;
+	s64 above = 0;
+
+	if (!sk)
+		return;
+	hist = kzalloc((HDD_SKETCH_MAX + 1) * sizeof(*hist), GFP_NOFS);
+	if (!hist)
+		return;		/* ԭ */
+
+	for (i = 0; i <= sk->sk_mask; i++) {
+		hist[sk->sk_rows[i]]++;
+		if (!(i & 65535))
+			cond_resched();
+	}
+	for (lvl = HDD_SKETCH_MAX; lvl > 0; lvl--) {	/*  0 Ӳ */
+		if (above + hist[lvl] > budget)
+			break;
+		above += hist[lvl];
+	}
+	sbi->s_sketch_level = lvl;
+	kfree(hist);
+}
+
+/*  kbytes  sketch, пȡڴƵ 2  */
+int hdd_sketch_init(struct hdd_sb_info *sbi, unsigned int kbytes)
+{
+	struct hdd_sketch *sk;
+	unsigned int width = 256;
+
+	while (width * 2 * HDD_SKETCH_DEPTH <= (size_t) kbytes << 10)
+		width *= 2;
+
+	sk = kzalloc(sizeof(*sk), GFP_KERNEL);
+	if (!sk)
+		return -ENOMEM;
+	sk->sk_size = (size_t) width * HDD_SKETCH_DEPTH;
+	sk->sk_rows = vmalloc(sk->sk_size);
+	if (!sk->sk_rows) {
+		kfree(sk);
+		return -ENOMEM;
+	}
+	memset(sk->sk_rows, 0, sk->sk_size);
+
+	sk->sk_mask = width - 1;
+	sk->sk_window = width * HDD_SKETCH_WINDOW;
+	get_random_bytes(sk->sk_seed, sizeof(sk->sk_seed));
+	atomic_set(&sk->sk_adds, 0);
+
+	sbi->s_sketch_level = HDD_SKETCH_MAX;	/* ״дµ */
+	sbi->s_sketch = sk;
+	return 0;
+}
+
+/* ͷ sketch, жʱ */
+void hdd_sketch_destroy(struct hdd_sb_info *sbi)
+{
+	struct hdd_sketch *sk = sbi->s_sketch;
+
+	if (!sk)
+		return;
+	vfree(sk->sk_rows);
+	kfree(sk);
+	sbi->s_sketch = NULL;
+}
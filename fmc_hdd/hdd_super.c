@@ -63,6 +63,20 @@ static struct inode *hdd_alloc_inode(struct super_block *sb)
 		return NULL;
 
 	hi->vfs_inode.i_version = 1;
+	hi->i_block_alloc_info = NULL;
+	hi->i_reserved_data_blocks = 0;
+
+	/* ѱ, ڴ˳ʼ */
+	spin_lock_init(&hi->i_range_lock);
+	INIT_LIST_HEAD(&hi->i_ranges);
+	init_waitqueue_head(&hi->i_range_wait);
+	spin_lock_init(&hi->i_map_lock);
+	INIT_LIST_HEAD(&hi->i_map_list);
+	INIT_LIST_HEAD(&hi->i_map_lru);
+	INIT_LIST_HEAD(&hi->i_acc_list);
+	INIT_LIST_HEAD(&hi->i_acc_inodes);
+	init_rwsem(&hi->i_data_sem);
+	seqlock_init(&hi->i_meta_seq);
 
 	return &hi->vfs_inode;
 }
@@ -76,15 +90,31 @@ static void hdd_destroy_inode(struct inode *inode)
 /* ͷ inode ˽ϢзĿռ */
 static void hdd_clear_inode(struct inode *inode)
 {
-	// void;
+	struct hdd_block_alloc_info *rsv = HDD_I(inode)->i_block_alloc_info;
+
+	hdd_discard_reservation(inode);	/* ͷſԤ */
+	hdd_access_forget(inode);	/* δдķ */
+	hdd_map_cache_drop(inode);	/* ͷӳ仺 */
+
+	/* ҳȫͷ, Ӧӳٿ */
+	if (unlikely(HDD_I(inode)->i_reserved_data_blocks)) {
+		hdd_msg(inode->i_sb, KERN_WARNING, "hdd_clear_inode",
+			"ino %lu still has %u reserved blocks", inode->i_ino,
+			HDD_I(inode)->i_reserved_data_blocks);
+		hdd_da_release_space(inode,
+			HDD_I(inode)->i_reserved_data_blocks);
+	}
+	HDD_I(inode)->i_block_alloc_info = NULL;
+	if (unlikely(rsv))
+		kfree(rsv);
 }
 
 static void hdd_do_sync_fs(struct super_block *sb, int wait)
 {
-	/* ֻļϵͳ, δ޸, ֱӷ;
-	   ռгд, ֹ𴦶д;
-	   ȻϢ: п;
-	   ǳ黺Ϊ.
+	/* ߳ sbi_rwsem д, ֻд߻;
+	   ͷ·, ٻܼ,
+	   ڼĸ», ´дز;
+	   סд, ֤дĳ鲻˺.
 	*/
 
 	struct hdd_sb_info *sbi = HDD_SB(sb);
@@ -92,6 +122,12 @@ static void hdd_do_sync_fs(struct super_block *sb, int wait)
 	unsigned int tmp = 0;
 	int i = 0;
 
+	sbi->s_dirty = 0;
+	sb->s_dirt = 0;
+	smp_mb();	/* ڶ */
+
+	lock_buffer(sbi->hdd_bh);
+
 	tmp = percpu_counter_sum_positive(&sbi->usr_blocks);
 	hdd_sb->s_user_blocks = cpu_to_le32(tmp);
 
@@ -114,17 +150,19 @@ static void hdd_do_sync_fs(struct super_block *sb, int wait)
 	hdd_sb->s_total_access = cpu_to_le64(
 		percpu_counter_sum_positive(&sbi->total_access));/* ܷʴ */
 
+	down_read(&sbi->s_heat_sem);		/* ͳԪһ */
 	for (i = 0; i < FMC_MAX_LEVELS; ++i) {		/* Լ1K-ÿʼĿ */
 		tmp = percpu_counter_sum_positive(&sbi->blks_per_lvl[i]);
 		hdd_sb->s_blks_per_level[i] = cpu_to_le32(tmp);
 	}
+	hdd_sb->s_heat_epoch = cpu_to_le32(sbi->s_heat_epoch);
+	up_read(&sbi->s_heat_sem);
+
+	unlock_buffer(sbi->hdd_bh);
 
 	mark_buffer_dirty(sbi->hdd_bh);       /* ǳΪ */
 	if (wait)
 		sync_dirty_buffer(sbi->hdd_bh);       /* ͬ */
-
-	sbi->s_dirty = 0;
-	sb->s_dirt = 0;
 }
 
 /* ͬļϵͳ */
@@ -132,7 +170,11 @@ static int hdd_sync_fs(struct super_block *sb, int wait)
 {
 	struct hdd_sb_info *sbi = HDD_SB(sb);
 
-	if (sb->s_flags & MS_RDONLY || !sbi->s_dirty)
+	if (sb->s_flags & MS_RDONLY)
+		return 0;
+
+	hdd_access_fold(sb);		/* д, Ū೬ */
+	if (!sbi->s_dirty)
 		return 0;
 	
 	down_write(&sbi->sbi_rwsem);
@@ -164,6 +206,11 @@ static void hdd_put_super(struct super_block *sb)
 
 	hdd_release_ssd(sbi);		/* ȡ ssd Ĺ */
 
+	hdd_promote_proc_unregister(sb);/* ɾ /proc µͳ */
+	hdd_ra_proc_unregister(sb);
+	hdd_access_destroy(sbi);	/* inode ȫͷ */
+	hdd_sketch_destroy(sbi);
+
 	sb->s_fs_info = NULL;
 
 	percpu_counter_destroy(&sbi->usr_blocks);
@@ -171,8 +218,20 @@ static void hdd_put_super(struct super_block *sb)
 	percpu_counter_destroy(&sbi->free_inodes_count);
 	percpu_counter_destroy(&sbi->total_access);
 	percpu_counter_destroy(&sbi->ssd_blks_count);
+	percpu_counter_destroy(&sbi->dirty_blks_count);
+	percpu_counter_destroy(&sbi->pending_free_blks);
 	for (i = 0; i < FMC_MAX_LEVELS; i++)
 		percpu_counter_destroy(&sbi->blks_per_lvl[i]);
+	for (i = 0; i < 2; i++) {
+		percpu_counter_destroy(&sbi->s_ra_reads[i]);
+		percpu_counter_destroy(&sbi->s_ra_read_pages[i]);
+		percpu_counter_destroy(&sbi->s_ra_bios[i]);
+	}
+	percpu_counter_destroy(&sbi->s_promote_admit);
+	percpu_counter_destroy(&sbi->s_promote_seq);
+	percpu_counter_destroy(&sbi->s_promote_above);
+
+	hdd_fext_destroy(sbi);		/* ͷſ extent  */
 
 	for (i = 0; i < sbi->gdt_blocks; i++)
 		if (sbi->group_desc[i])
@@ -196,6 +255,7 @@ static int hdd_statfs (struct dentry * dentry, struct kstatfs * buf)
 	struct hdd_sb_info *sbi = HDD_SB(sb);
 	//struct hdd_super_block *hdd_sb = sbi->hdd_sb;
 	u64 id = huge_encode_dev(sb->s_bdev->bd_dev);
+	s64 free_blocks;
 
 	buf->f_type = HDD_MAGIC;
 	buf->f_bsize = sbi->block_size;
@@ -203,8 +263,16 @@ static int hdd_statfs (struct dentry * dentry, struct kstatfs * buf)
 	buf->f_blocks = sbi->groups_count * sbi->block_size * 8 -
 		(sbi->blks_per_group - sbi->last_group_blks);
 
-	buf->f_bfree = percpu_counter_sum_positive(&sbi->free_blks_count);
-	buf->f_bavail = buf->f_bfree;
+	/* ӳٷԤĿ鲻ٿ */
+	free_blocks = percpu_counter_sum_positive(&sbi->free_blks_count) -
+		percpu_counter_sum_positive(&sbi->dirty_blks_count);
+	if (free_blocks < 0)
+		free_blocks = 0;
+
+	/* ں̨ͷŵĿ, ܷ */
+	buf->f_bavail = free_blocks;
+	buf->f_bfree = free_blocks +
+		percpu_counter_sum_positive(&sbi->pending_free_blks);
 
 	buf->f_files = sbi->inodes_count;
 	buf->f_ffree = percpu_counter_sum_positive(&sbi->free_inodes_count);
@@ -239,6 +307,27 @@ static int hdd_show_options(struct seq_file *seq, struct vfsmount *vfs)
 	if (sbi->cld_name)
 		seq_printf(seq, ", cloud service: %s", sbi->cld_name);
 
+	if (test_opt(sb, EXTENTS))
+		seq_puts(seq, ",extents");
+	if (!test_opt(sb, RESERVATION))
+		seq_puts(seq, ",noreservation");
+	if (test_opt(sb, DELALLOC))
+		seq_puts(seq, ",delalloc");
+	if (sbi->s_ra_pages[BLOCK_ON_HDD] != HDD_RA_HDD_PAGES)
+		seq_printf(seq, ",ra_hdd=%u", sbi->s_ra_pages[BLOCK_ON_HDD]);
+	if (sbi->s_ra_pages[BLOCK_ON_SSD] != HDD_RA_SSD_PAGES)
+		seq_printf(seq, ",ra_ssd=%u", sbi->s_ra_pages[BLOCK_ON_SSD]);
+	if (sbi->s_acc_interval != HDD_ACCESS_INTERVAL)
+		seq_printf(seq, ",access_interval=%u", sbi->s_acc_interval);
+	if (sbi->s_heat_period != HDD_HEAT_PERIOD)
+		seq_printf(seq, ",heat_period=%u", sbi->s_heat_period);
+	if (sbi->s_sketch_kb)
+		seq_printf(seq, ",heat_sketch=%u", sbi->s_sketch_kb);
+	if (sbi->s_seq_cutoff != HDD_SEQ_CUTOFF)
+		seq_printf(seq, ",seq_cutoff=%u", sbi->s_seq_cutoff);
+	if (sbi->s_promote_ratio != HDD_PROMOTE_RATIO)
+		seq_printf(seq, ",promote_ratio=%u", sbi->s_promote_ratio);
+
 	seq_printf(seq, ", upper ratio: %u%%", sbi->upper_ratio);
 	seq_printf(seq, ", cloud service: %u seconds", sbi->max_unaccess);
 
@@ -341,6 +430,10 @@ static int init_sb_info(struct hdd_sb_info *sbi)
 	init_rwsem(&sbi->sbi_rwsem);
 	mutex_init(&sbi->ssd_mutex);
 	spin_lock_init(&sbi->cld_lock);
+	spin_lock_init(&sbi->s_rsv_window_lock);
+	sbi->s_rsv_window_root = RB_ROOT;
+	mutex_init(&sbi->s_pending_lock);
+	sbi->s_pending_head = le32_to_cpu(h->s_pending_free_head);
 
 	err = percpu_counter_init(&sbi->usr_blocks, 
 		le32_to_cpu(h->s_user_blocks));
@@ -368,10 +461,137 @@ static int init_sb_info(struct hdd_sb_info *sbi)
 		err = percpu_counter_init(&sbi->ssd_blks_count, 
 			le32_to_cpu(h->s_ssd_blocks_count));
 	}
+	if (!err)
+		err = percpu_counter_init(&sbi->dirty_blks_count, 0);
+	if (!err)
+		err = percpu_counter_init(&sbi->pending_free_blks, 0);
+	for (i = 0; i < 2 && !err; i++) {	/* Ԥͳ */
+		err = percpu_counter_init(&sbi->s_ra_reads[i], 0);
+		if (!err)
+			err = percpu_counter_init(&sbi->s_ra_read_pages[i], 0);
+		if (!err)
+			err = percpu_counter_init(&sbi->s_ra_bios[i], 0);
+	}
+	if (!err)
+		err = percpu_counter_init(&sbi->s_promote_admit, 0);
+	if (!err)
+		err = percpu_counter_init(&sbi->s_promote_seq, 0);
+	if (!err)
+		err = percpu_counter_init(&sbi->s_promote_above, 0);
+	sbi->s_promote_level = FMC_MAX_LEVELS - 1;	/* ״дµ */
+	if (!err)
+		err = hdd_access_init(sbi);	/* ÿ CPU ķʼ¼ */
 	
 	return err;
 }
 
+/* ѡ */
+enum {
+	Opt_extents, Opt_noextents, Opt_reservation, Opt_noreservation,
+	Opt_delalloc, Opt_nodelalloc, Opt_ra_hdd, Opt_ra_ssd,
+	Opt_access_interval, Opt_heat_period, Opt_heat_sketch,
+	Opt_seq_cutoff, Opt_promote_ratio, Opt_err
+};
+
+static const match_table_t tokens = {
+	{Opt_extents,		"extents"},
+	{Opt_noextents,		"noextents"},
+	{Opt_reservation,	"reservation"},
+	{Opt_noreservation,	"noreservation"},
+	{Opt_delalloc,		"delalloc"},
+	{Opt_nodelalloc,	"nodelalloc"},
+	{Opt_ra_hdd,		"ra_hdd=%u"},
+	{Opt_ra_ssd,		"ra_ssd=%u"},
+	{Opt_access_interval,	"access_interval=%u"},
+	{Opt_heat_period,	"heat_period=%u"},
+	{Opt_heat_sketch,	"heat_sketch=%u"},
+	{Opt_seq_cutoff,	"seq_cutoff=%u"},
+	{Opt_promote_ratio,	"promote_ratio=%u"},
+	{Opt_err,		NULL}
+};
+
+/* ѡ */
+static int parse_options(char *options, struct hdd_sb_info *sbi)
+{
+	char *p;
+	substring_t args[MAX_OPT_ARGS];
+	int option;
+
+	if (!options)
+		return 1;
+
+	while ((p = strsep(&options, ",")) != NULL) {
+		int token;
+		if (!*p)
+			continue;
+
+		token = match_token(p, tokens, args);
+		switch (token) {
+		case Opt_extents:
+			set_opt(sbi->mount_opt, EXTENTS);
+			break;
+		case Opt_noextents:
+			clear_opt(sbi->mount_opt, EXTENTS);
+			break;
+		case Opt_reservation:
+			set_opt(sbi->mount_opt, RESERVATION);
+			break;
+		case Opt_noreservation:
+			clear_opt(sbi->mount_opt, RESERVATION);
+			break;
+		case Opt_delalloc:
+			set_opt(sbi->mount_opt, DELALLOC);
+			break;
+		case Opt_nodelalloc:
+			clear_opt(sbi->mount_opt, DELALLOC);
+			break;
+		case Opt_ra_hdd:	/* HDD ϵԤ, λΪҳ */
+			if (match_int(&args[0], &option) || option < 0)
+				return 0;
+			sbi->s_ra_pages[BLOCK_ON_HDD] = option;
+			break;
+		case Opt_ra_ssd:	/* SSD ϵԤ, λΪҳ */
+			if (match_int(&args[0], &option) || option < 0)
+				return 0;
+			sbi->s_ra_pages[BLOCK_ON_SSD] = option;
+			break;
+		case Opt_access_interval:/* д, λΪ */
+			if (match_int(&args[0], &option) || option < 0)
+				return 0;
+			sbi->s_acc_interval = option;
+			break;
+		case Opt_heat_period:	/* ʼ, λΪ, 0 Ϊ˥ */
+			if (match_int(&args[0], &option) || option < 0 ||
+			    (option && option < HDD_HEAT_MIN_PERIOD))
+				return 0;
+			sbi->s_heat_period = option;
+			break;
+		case Opt_heat_sketch:	/* ȶ sketch ڴ, λΪ KB, 0 Ϊ */
+			if (match_int(&args[0], &option) || option < 0 ||
+			    option > HDD_SKETCH_MAX_KB)
+				return 0;
+			sbi->s_sketch_kb = option;
+			break;
+		case Opt_seq_cutoff:	/* ˳, 0 Ϊ */
+			if (match_int(&args[0], &option) || option < 0)
+				return 0;
+			sbi->s_seq_cutoff = option;
+			break;
+		case Opt_promote_ratio:	/* ȿõ SSD пٷֱ */
+			if (match_int(&args[0], &option) || option < 0 ||
+			    option > 100)
+				return 0;
+			sbi->s_promote_ratio = option;
+			break;
+		default:
+			printk(KERN_ERR "FMC-hdd: Unrecognized mount option "
+			       "\"%s\" or missing value\n", p);
+			return 0;
+		}
+	}
+	return 1;
+}
+
 /* ļ */
 static loff_t hdd_max_size(void)
 {
@@ -629,6 +849,23 @@ static int hdd_fill_sb(struct super_block *sb, void *data, int silent)
 		goto free_per_cpu;
 	}
 
+	set_opt(sbi->mount_opt, RESERVATION);	/* ĬʹÿԤ */
+	sbi->s_ra_pages[BLOCK_ON_HDD] = HDD_RA_HDD_PAGES;
+	sbi->s_ra_pages[BLOCK_ON_SSD] = HDD_RA_SSD_PAGES;
+	sbi->s_acc_interval = HDD_ACCESS_INTERVAL;
+	sbi->s_heat_period = HDD_HEAT_PERIOD;
+	sbi->s_seq_cutoff = HDD_SEQ_CUTOFF;
+	sbi->s_promote_ratio = HDD_PROMOTE_RATIO;
+	if (!parse_options((char *) data, sbi)) {	/* ѡ */
+		err = -EINVAL;
+		goto free_per_cpu;
+	}
+	if (sbi->s_sketch_kb && hdd_sketch_init(sbi, sbi->s_sketch_kb) < 0) {
+		err = -ENOMEM;
+		hdd_msg(sb, KERN_ERR,__func__,"Unable to allocate heat sketch");
+		goto free_per_cpu;
+	}
+
 	sbi->sb = sb;
 	sb->s_fs_info	= sbi;
 	sb->s_maxbytes	= hdd_max_size();	/* ļ */
@@ -637,6 +874,19 @@ static int hdd_fill_sb(struct super_block *sb, void *data, int silent)
 	sb->s_export_op = &hdd_export_ops;
 	sb->s_xattr	= NULL;
 
+	if (hdd_fext_init(sb) < 0) {		/*  extent ͿժҪ */
+		err = -ENOMEM;
+		hdd_msg(sb, KERN_ERR,__func__,"Unable to allocate group_info");
+		goto empty_sb_fs;
+	}
+
+	/* ڱռס 0, ӲΪ */
+	sbi->s_rsv_window_head.rsv_start = HDD_RESERVE_WINDOW_NOT_ALLOCATED;
+	sbi->s_rsv_window_head.rsv_end = HDD_RESERVE_WINDOW_NOT_ALLOCATED;
+	sbi->s_rsv_window_head.rsv_alloc_hit = 0;
+	sbi->s_rsv_window_head.rsv_goal_size = 0;
+	hdd_rsv_window_add(sb, &sbi->s_rsv_window_head);
+
 	if (hdd_get_ssd(sbi) < 0){		/* ȡ SSD Ϣ */
 		hdd_msg(sb, KERN_ERR,__func__,"Unable to get ssd info");
 		goto empty_sb_fs;
@@ -678,11 +928,30 @@ static int hdd_fill_sb(struct super_block *sb, void *data, int silent)
 
 	/* ļϵͳ */
 	hdd_setup_super(sb, hdd_sb, sb->s_flags & MS_RDONLY);
+
+	/* ̨ͷ߳, ϴδͷ inode */
+	if (!(sb->s_flags & MS_RDONLY) && hdd_start_reclaim(sb) < 0)
+		hdd_msg(sb, KERN_WARNING, __func__,
+			"Unable to start reclaim thread, deleting synchronously");
+
+	/* Ԥͽͳ, ʧܲӰ */
+	if (hdd_ra_proc_register(sb) < 0 || hdd_promote_proc_register(sb) < 0) {
+		hdd_ra_proc_unregister(sb);
+		hdd_msg(sb, KERN_WARNING, __func__,
+			"Unable to create statistics in /proc");
+	}
 	
 	fmc_debug("After hdd_setup_super() ............\n");
-	return -ENOMEM;
+	err = -ENOMEM;		/* δĿ¼, ϵ */
+	goto put_root;
 	return 0;
 
+put_root:
+	hdd_promote_proc_unregister(sb);
+	hdd_ra_proc_unregister(sb);
+	hdd_stop_reclaim(sb);		/*  inode  */
+	iput(root);
+
 release_ssd:
 	hdd_release_ssd(sbi);
 
@@ -690,13 +959,26 @@ empty_sb_fs:
 	sb->s_fs_info = NULL;
 
 free_per_cpu:
+	hdd_fext_destroy(sbi);
+	hdd_access_destroy(sbi);
+	hdd_sketch_destroy(sbi);
 	percpu_counter_destroy(&sbi->usr_blocks);
 	percpu_counter_destroy(&sbi->free_blks_count);
 	percpu_counter_destroy(&sbi->free_inodes_count);
 	percpu_counter_destroy(&sbi->total_access);
 	percpu_counter_destroy(&sbi->ssd_blks_count);
+	percpu_counter_destroy(&sbi->dirty_blks_count);
+	percpu_counter_destroy(&sbi->pending_free_blks);
 	for (i = 0; i < FMC_MAX_LEVELS; i++)
 		percpu_counter_destroy(&sbi->blks_per_lvl[i]);
+	for (i = 0; i < 2; i++) {
+		percpu_counter_destroy(&sbi->s_ra_reads[i]);
+		percpu_counter_destroy(&sbi->s_ra_read_pages[i]);
+		percpu_counter_destroy(&sbi->s_ra_bios[i]);
+	}
+	percpu_counter_destroy(&sbi->s_promote_admit);
+	percpu_counter_destroy(&sbi->s_promote_seq);
+	percpu_counter_destroy(&sbi->s_promote_above);
 
 //release_gdt_bh:
 	for (i = 0; i < sbi->gdt_blocks; i++)
@@ -731,7 +1013,6 @@ static void init_once(void *foo)
 {
 	struct hdd_inode_info *hdi = (struct hdd_inode_info *) foo;
 
-	rwlock_init(&hdi->i_meta_lock);
 	mutex_init(&hdi->truncate_mutex);
 	
 	inode_init_once(&hdi->vfs_inode); /* ʼ inode  */
@@ -760,12 +1041,20 @@ static void destroy_inodecache(void)
 	kmem_cache_destroy(hdd_inode_cachep);
 }
 
+/* ж: ͷ inode ֮ǰֹ̨ͣͷ߳,  inode  */
+static void hdd_kill_sb(struct super_block *sb)
+{
+	if (HDD_SB(sb))
+		hdd_stop_reclaim(sb);
+	kill_block_super(sb);
+}
+
 /* fmc_hdd ļϵͳṹ */
 static struct file_system_type hdd_fs_type = {
 	.owner	 = THIS_MODULE,
 	.name	 = "fmc_hdd",
 	.get_sb	 = hdd_get_sb,
-	.kill_sb = kill_block_super,
+	.kill_sb = hdd_kill_sb,
 	.fs_flags= FS_REQUIRES_DEV,
 };
 
@@ -777,6 +1066,16 @@ static int __init init_hdd_fs(void)
 	if (err)
 		goto out1;
 
+	err = hdd_init_fext_cache();/*  extent  */
+	if (err)
+		goto out2;
+
+	err = hdd_init_map_cache();/*  inode ӳ仺 */
+	if (err)
+		goto out3;
+
+	hdd_init_ra_proc();/*  /proc/fs/fmc_hdd */
+
 	err = register_filesystem(&hdd_fs_type);
 	if (err)
 		goto out;
@@ -784,6 +1083,11 @@ static int __init init_hdd_fs(void)
 	printk("registered fmc_hdd filesystem.............\n");
 	return 0;
 out:
+	hdd_destroy_ra_proc();
+	hdd_destroy_map_cache();
+out3:
+	hdd_destroy_fext_cache();
+out2:
 	destroy_inodecache();/* inode ˽Ϣ */
 out1:
 	return err;
@@ -794,6 +1098,9 @@ static void __exit exit_hdd_fs(void)
 {
 	unregister_filesystem(&hdd_fs_type);
 	printk("Unregistered fmc_hdd filesystem.............\n");
+	hdd_destroy_ra_proc();/* ɾ /proc/fs/fmc_hdd */
+	hdd_destroy_map_cache();/*  inode ӳ仺 */
+	hdd_destroy_fext_cache();/* ٿ extent  */
 	destroy_inodecache();/* inode ˽Ϣ */
 }
 
@@ -0,0 +1,165 @@
+/*
+ * bench_alloc.c - Multi-threaded block allocation throughput.
+ *
+ * Copyright (C) 2013 by Xuesen Liang, <liangxuesen@gmail.com>
+ * @ Beijing University of Posts and Telecommunications,
+ * @ CPU Center of Tsinghua University.
+ *
+ * This program can be redistributed under the terms of the GNU Public License.
+ */
+
+/* Usage: bench_alloc [options] dir
+ *
+ * eg: bench_alloc -t 1,2,4,8 -n 65536 /mnt/hdd
+ *	-t: ߳, ŷָ, β [Ĭ: 1,2,4,8]
+ *	-n: ÿ̷߳Ŀ [Ĭ: 32768]
+ *	-m: f -  fallocate, ֻ߷·; w - д fsync [Ĭ: f]
+ *	dir: fmc_hdd ϵĿ¼
+ *
+ * ÿ߳ dir ¸һļ,  4K , ߳ͬʱʼ, ȫ
+ * ʱʱ. ÿĿԵһ߳ļٱ, 
+ * ۲ͷ·ϵļǷ CPU չ.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#define BENCH_BLOCK	4096
+
+static const char *dir;
+static long nr_blocks = 32768;
+static int mode = 'f';
+static pthread_barrier_t start;
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void *alloc_thread(void *arg)
+{
+	long id = (long) arg, i;
+	char path[4096], buf[BENCH_BLOCK];
+	int fd, err = 0;
+
+	snprintf(path, sizeof(path), "%s/bench_alloc.%ld", dir, id);
+	fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	if (fd < 0) {
+		perror(path);
+		pthread_barrier_wait(&start);
+		return (void *) 1;
+	}
+	memset(buf, 0x5a, sizeof(buf));
+
+	pthread_barrier_wait(&start);
+	for (i = 0; i < nr_blocks && !err; i++) {
+		if (mode == 'f')
+			err = fallocate(fd, 0, i * BENCH_BLOCK, BENCH_BLOCK);
+		else
+			err = pwrite(fd, buf, BENCH_BLOCK, i * BENCH_BLOCK)
+				!= BENCH_BLOCK;
+	}
+	if (!err && mode == 'w')
+		err = fsync(fd);
+	if (err)
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+
+	close(fd);
+	return (void *) (long) (err != 0);
+}
+
+/*  threads ̷߳, ÿĿ, ظ */
+static double run(long threads)
+{
+	pthread_t *tid = calloc(threads, sizeof(*tid));
+	char path[4096];
+	double t0, t1;
+	void *ret;
+	long i;
+	int err = 0;
+
+	if (!tid)
+		return -1;
+	pthread_barrier_init(&start, NULL, threads + 1);
+	for (i = 0; i < threads; i++)
+		pthread_create(&tid[i], NULL, alloc_thread, (void *) i);
+
+	pthread_barrier_wait(&start);
+	t0 = now();
+	for (i = 0; i < threads; i++) {
+		pthread_join(tid[i], &ret);
+		err |= ret != NULL;
+	}
+	t1 = now();
+	pthread_barrier_destroy(&start);
+
+	for (i = 0; i < threads; i++) {
+		snprintf(path, sizeof(path), "%s/bench_alloc.%ld", dir, i);
+		unlink(path);
+	}
+	sync();		/* ͷŵĿдغٲһ */
+	free(tid);
+
+	return err ? -1 : threads * nr_blocks / (t1 - t0);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: bench_alloc [options] dir\n");
+	fprintf(stderr, "-t: thread counts [default:1,2,4,8]\n");
+	fprintf(stderr, "-n: blocks per thread [default:32768]\n");
+	fprintf(stderr, "-m: f - fallocate, w - write and fsync [default:f]\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	char threads[256] = "1,2,4,8";
+	double rate, base = 0;
+	char *p;
+	int c;
+
+	while ((c = getopt(argc, argv, "t:n:m:")) != -1) {
+		switch (c) {
+		case 't':
+			snprintf(threads, sizeof(threads), "%s", optarg);
+			break;
+		case 'n':
+			nr_blocks = atol(optarg);
+			break;
+		case 'm':
+			mode = optarg[0];
+			if (mode != 'f' && mode != 'w')
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1 || nr_blocks <= 0)
+		usage();
+	dir = argv[optind];
+
+	printf("%8s %14s %8s\n", "threads", "blocks/s", "speedup");
+	for (p = strtok(threads, ","); p; p = strtok(NULL, ",")) {
+		if (atol(p) <= 0)
+			usage();
+		rate = run(atol(p));
+		if (rate < 0)
+			return 1;
+		if (!base)
+			base = rate;
+		printf("%8ld %14.0f %8.2f\n", atol(p), rate, rate / base);
+	}
+	return 0;
+}
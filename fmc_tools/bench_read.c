@@ -0,0 +1,184 @@
+/*
+ * bench_read.c - Many readers doing random lookups in one file.
+ *
+ * Copyright (C) 2013 by Xuesen Liang, <liangxuesen@gmail.com>
+ * @ Beijing University of Posts and Telecommunications,
+ * @ CPU Center of Tsinghua University.
+ *
+ * This program can be redistributed under the terms of the GNU Public License.
+ */
+
+/* Usage: bench_read [options] file
+ *
+ * eg: bench_read -t 1,4,16 -s 10 /mnt/hdd/big
+ *	-t: ߳, ŷָ, β [Ĭ: 1,2,4,8,16]
+ *	-s: ÿ߳ [Ĭ: 5]
+ *	-m: b - FIBMAP ֻҿ, 豸, Ҫ root; d - O_DIRECT  4K
+ *	    [Ĭ: b]
+ *	file: fmc_hdd дĴļ,  4M ʱžӿ
+ *
+ * ߳ͬһļѡ, ͬʱи, ÿĲ
+ * Եһ߳ļٱ. FIBMAP  hdd_bmap  hdd_get_block,
+ * ַֻҵĲչ; O_DIRECT ÿζҲȲҵַ.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+#define BENCH_BLOCK	4096
+
+static const char *path;
+static long nr_blocks;			/* ļĿ */
+static int mode = 'b';
+static volatile int stop;
+static pthread_barrier_t start;
+
+struct reader {
+	pthread_t	tid;
+	unsigned int	seed;
+	long		ops;		/* ɵĲ */
+	int		err;
+};
+
+static void *read_thread(void *arg)
+{
+	struct reader *r = arg;
+	void *buf = NULL;
+	int fd, blk;
+	long n;
+
+	fd = open(path, O_RDONLY | (mode == 'd' ? O_DIRECT : 0));
+	if (fd < 0 || (mode == 'd' &&
+	    posix_memalign(&buf, BENCH_BLOCK, BENCH_BLOCK))) {
+		r->err = errno;
+		pthread_barrier_wait(&start);
+		return NULL;
+	}
+
+	pthread_barrier_wait(&start);
+	while (!stop) {
+		n = rand_r(&r->seed) % nr_blocks;
+		if (mode == 'b') {
+			blk = n;
+			if (ioctl(fd, FIBMAP, &blk) < 0) {
+				r->err = errno;
+				break;
+			}
+		} else if (pread(fd, buf, BENCH_BLOCK, n * BENCH_BLOCK) < 0) {
+			r->err = errno;
+			break;
+		}
+		r->ops++;
+	}
+
+	free(buf);
+	close(fd);
+	return NULL;
+}
+
+/*  threads ߳ secs , ÿ, ظ */
+static double run(long threads, int secs)
+{
+	struct reader *r = calloc(threads, sizeof(*r));
+	long i, ops = 0;
+	int err = 0;
+
+	if (!r)
+		return -1;
+	stop = 0;
+	pthread_barrier_init(&start, NULL, threads + 1);
+	for (i = 0; i < threads; i++) {
+		r[i].seed = i + 1;
+		pthread_create(&r[i].tid, NULL, read_thread, &r[i]);
+	}
+
+	pthread_barrier_wait(&start);
+	sleep(secs);
+	stop = 1;
+	for (i = 0; i < threads; i++) {
+		pthread_join(r[i].tid, NULL);
+		ops += r[i].ops;
+		if (r[i].err)
+			err = r[i].err;
+	}
+	pthread_barrier_destroy(&start);
+	free(r);
+
+	if (err) {
+		fprintf(stderr, "%s: %s\n", path, strerror(err));
+		return -1;
+	}
+	return (double) ops / secs;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: bench_read [options] file\n");
+	fprintf(stderr, "-t: thread counts [default:1,2,4,8,16]\n");
+	fprintf(stderr, "-s: seconds per thread count [default:5]\n");
+	fprintf(stderr, "-m: b - FIBMAP lookups, d - O_DIRECT 4K reads [default:b]\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	char threads[256] = "1,2,4,8,16";
+	double rate, base = 0;
+	struct stat st;
+	int secs = 5;
+	char *p;
+	int c;
+
+	while ((c = getopt(argc, argv, "t:s:m:")) != -1) {
+		switch (c) {
+		case 't':
+			snprintf(threads, sizeof(threads), "%s", optarg);
+			break;
+		case 's':
+			secs = atoi(optarg);
+			break;
+		case 'm':
+			mode = optarg[0];
+			if (mode != 'b' && mode != 'd')
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1 || secs <= 0)
+		usage();
+	path = argv[optind];
+
+	if (stat(path, &st) < 0) {
+		perror(path);
+		return 1;
+	}
+	nr_blocks = st.st_size / BENCH_BLOCK;
+	if (!nr_blocks) {
+		fprintf(stderr, "%s: file is smaller than one block\n", path);
+		return 1;
+	}
+
+	printf("%8s %14s %8s\n", "threads", "lookups/s", "speedup");
+	for (p = strtok(threads, ","); p; p = strtok(NULL, ",")) {
+		if (atol(p) <= 0)
+			usage();
+		rate = run(atol(p), secs);
+		if (rate < 0)
+			return 1;
+		if (!base)
+			base = rate;
+		printf("%8ld %14.0f %8.2f\n", atol(p), rate, rate / base);
+	}
+	return 0;
+}
@@ -0,0 +1,404 @@
+/*
+ * bench_sketch.c - Accuracy of the heat sketch versus exact counting.
+ *
+ * Copyright (C) 2013 by Xuesen Liang, <liangxuesen@gmail.com>
+ * @ Beijing University of Posts and Telecommunications,
+ * @ CPU Center of Tsinghua University.
+ *
+ * This program can be redistributed under the terms of the GNU Public License.
+ */
+
+/* Usage: bench_sketch [options] [trace]
+ *
+ * eg: bench_sketch -m 16,64,256,1024 access.trace
+ *	-m: sketch ڴ, λ KB, ŷָ [Ĭ: 16,64,256,1024,4096]
+ *	-z: ޼¼ʱ Zipf еķ [Ĭ: 4000000]
+ *	-b: Zipf еĿ [Ĭ: 1000000]
+ *	-s: Zipf еб [Ĭ: 0.9]
+ *	-k: ȿ鼯ϵĴС,  SSD ÿ [Ĭ:  1%, ¼Ϊ 1%]
+ *	trace: ¼ķ, ÿ "ino lblk"
+ *
+ *  fmc_hdd/hdd_sketch.c ͬ㷨(4  8 λ, ظ, ÿ
+ * 8 пηʼ)طŷ, ͬʱȷͬһʱ̼, Ƚ:
+ *	mae:	ÿֵ뾫ȷֵ֮ƽ
+ *	exact:	ֵھȷֵĿı
+ *	prec:	ֲȡ(޵Ĳ k )ѡȿ, 
+ *		ȿı
+ *	recall:	ȿбѡı
+ * ȿ鰴ȷֵͬķѡ,  k .
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <inttypes.h>
+
+#define SKETCH_DEPTH	4		/*  */
+#define SKETCH_WINDOW	8		/* ÿ 8 пηʼһ */
+#define SKETCH_MAX	255		/* ֵ */
+
+/* ں 2.6.32  jhash_2words ͬ */
+#define JHASH_GOLDEN_RATIO	0x9e3779b9
+#define __jhash_mix(a, b, c) \
+{ \
+	a -= b; a -= c; a ^= (c >> 13); \
+	b -= c; b -= a; b ^= (a << 8); \
+	c -= a; c -= b; c ^= (b >> 13); \
+	a -= b; a -= c; a ^= (c >> 12); \
+	b -= c; b -= a; b ^= (a << 16); \
+	c -= a; c -= b; c ^= (b >> 5); \
+	a -= b; a -= c; a ^= (c >> 3); \
+	b -= c; b -= a; b ^= (a << 10); \
+	c -= a; c -= b; c ^= (b >> 15); \
+}
+
+static uint32_t jhash_2words(uint32_t a, uint32_t b, uint32_t initval)
+{
+	uint32_t c = initval;
+
+	a += JHASH_GOLDEN_RATIO;
+	b += JHASH_GOLDEN_RATIO;
+	__jhash_mix(a, b, c);
+	return c;
+}
+
+struct access {
+	uint32_t	ino;
+	uint32_t	lblk;
+};
+
+struct sketch {
+	uint32_t	mask;			/* п - 1 */
+	uint32_t	seed[2];
+	uint32_t	window;			/*  */
+	uint32_t	adds;			/* ϴμķ */
+	uint8_t		*rows;
+};
+
+/* ȷɢб, Ѱַ */
+struct exact {
+	uint64_t	mask;
+	struct access	*keys;
+	uint32_t	*count;
+	uint8_t		*used;
+	uint64_t	nr;			/* ͬ */
+};
+
+static uint64_t rnd_state = 88172645463325252ULL;
+
+static uint64_t rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state;
+}
+
+/* ڸеļ */
+static void sketch_slots(struct sketch *sk, struct access *a, uint8_t **slot)
+{
+	uint32_t h1 = jhash_2words(a->ino, a->lblk, sk->seed[0]);
+	uint32_t h2 = jhash_2words(a->ino, a->lblk, sk->seed[1]);
+	int i;
+
+	for (i = 0; i < SKETCH_DEPTH; i++)
+		slot[i] = sk->rows + (size_t) i * (sk->mask + 1) +
+			((h1 + i * h2) & sk->mask);
+}
+
+static unsigned int sketch_estimate(struct sketch *sk, struct access *a)
+{
+	uint8_t *slot[SKETCH_DEPTH];
+	unsigned int min = SKETCH_MAX;
+	int i;
+
+	sketch_slots(sk, a, slot);
+	for (i = 0; i < SKETCH_DEPTH; i++)
+		if (*slot[i] < min)
+			min = *slot[i];
+	return min;
+}
+
+/* һη, Ƿ񵽴 */
+static int sketch_add(struct sketch *sk, struct access *a)
+{
+	uint8_t *slot[SKETCH_DEPTH];
+	unsigned int min = SKETCH_MAX;
+	int i;
+
+	sketch_slots(sk, a, slot);
+	for (i = 0; i < SKETCH_DEPTH; i++)
+		if (*slot[i] < min)
+			min = *slot[i];
+	if (min < SKETCH_MAX)
+		for (i = 0; i < SKETCH_DEPTH; i++)
+			if (*slot[i] == min)
+				*slot[i] = min + 1;
+
+	if (++sk->adds < sk->window)
+		return 0;
+	sk->adds = 0;
+	for (i = 0; i < (int) ((sk->mask + 1) * SKETCH_DEPTH); i++)
+		sk->rows[i] >>= 1;
+	return 1;
+}
+
+/*  hdd_sketch_init ͬ: пȡڴƵ 2  */
+static int sketch_init(struct sketch *sk, unsigned int kbytes)
+{
+	uint32_t width = 256;
+
+	while ((size_t) width * 2 * SKETCH_DEPTH <= (size_t) kbytes << 10)
+		width *= 2;
+
+	sk->rows = calloc((size_t) width * SKETCH_DEPTH, 1);
+	if (!sk->rows)
+		return -1;
+	sk->mask = width - 1;
+	sk->window = width * SKETCH_WINDOW;
+	sk->adds = 0;
+	sk->seed[0] = (uint32_t) rnd();
+	sk->seed[1] = (uint32_t) rnd();
+	return 0;
+}
+
+static int exact_init(struct exact *ex, uint64_t nr_access)
+{
+	uint64_t size = 1024;
+
+	while (size < nr_access * 2)
+		size *= 2;
+	ex->mask = size - 1;
+	ex->nr = 0;
+	ex->keys = malloc(size * sizeof(*ex->keys));
+	ex->count = calloc(size, sizeof(*ex->count));
+	ex->used = calloc(size, 1);
+	return ex->keys && ex->count && ex->used ? 0 : -1;
+}
+
+static void exact_free(struct exact *ex)
+{
+	free(ex->keys);
+	free(ex->count);
+	free(ex->used);
+}
+
+static uint32_t *exact_slot(struct exact *ex, struct access *a)
+{
+	uint64_t i = jhash_2words(a->ino, a->lblk, 0) & ex->mask;
+
+	while (ex->used[i]) {
+		if (ex->keys[i].ino == a->ino && ex->keys[i].lblk == a->lblk)
+			return &ex->count[i];
+		i = (i + 1) & ex->mask;
+	}
+	ex->used[i] = 1;
+	ex->keys[i] = *a;
+	ex->nr++;
+	return &ex->count[i];
+}
+
+/* ɼֲȡ, ޵Ĳ budget  */
+static unsigned int hot_level(const uint64_t *hist, uint64_t budget)
+{
+	uint64_t above = 0;
+	unsigned int lvl;
+
+	for (lvl = SKETCH_MAX; lvl > 0; lvl--) {
+		if (above + hist[lvl] > budget)
+			break;
+		above += hist[lvl];
+	}
+	return lvl;
+}
+
+/* һڴСط trace һн */
+static int run(struct access *trace, uint64_t nr, unsigned int kbytes,
+	uint64_t hot)
+{
+	struct sketch sk;
+	struct exact ex;
+	uint64_t hist_sk[SKETCH_MAX + 1], hist_ex[SKETCH_MAX + 1];
+	uint64_t i, same = 0, tp = 0, sel = 0, real = 0;
+	unsigned int est, cnt, lvl_sk, lvl_ex;
+	double err = 0;
+
+	if (sketch_init(&sk, kbytes) < 0 || exact_init(&ex, nr) < 0) {
+		fprintf(stderr, "out of memory\n");
+		return -1;
+	}
+
+	for (i = 0; i < nr; i++) {
+		uint32_t *c = exact_slot(&ex, &trace[i]);
+
+		if (*c < SKETCH_MAX)
+			(*c)++;
+		if (sketch_add(&sk, &trace[i])) {	/* ȷֵͬʱ */
+			uint64_t j;
+
+			for (j = 0; j <= ex.mask; j++)
+				ex.count[j] >>= 1;
+		}
+	}
+
+	memset(hist_sk, 0, sizeof(hist_sk));
+	memset(hist_ex, 0, sizeof(hist_ex));
+	for (i = 0; i <= sk.mask; i++)
+		hist_sk[sk.rows[i]]++;
+	for (i = 0; i <= ex.mask; i++)
+		if (ex.used[i])
+			hist_ex[ex.count[i]]++;
+	lvl_sk = hot_level(hist_sk, hot);
+	lvl_ex = hot_level(hist_ex, hot);
+
+	for (i = 0; i <= ex.mask; i++) {
+		if (!ex.used[i])
+			continue;
+		est = sketch_estimate(&sk, &ex.keys[i]);
+		cnt = ex.count[i];
+		err += est - cnt;
+		same += est == cnt;
+		sel += est > lvl_sk;
+		real += cnt > lvl_ex;
+		tp += est > lvl_sk && cnt > lvl_ex;
+	}
+
+	printf("%8u %10u %8.3f %8.3f %8.3f %8.3f\n", kbytes, sk.mask + 1,
+	       err / ex.nr, (double) same / ex.nr,
+	       sel ? (double) tp / sel : 1.0, real ? (double) tp / real : 1.0);
+
+	free(sk.rows);
+	exact_free(&ex);
+	return 0;
+}
+
+/* ȡ¼ķ, ÿ "ino lblk" */
+static struct access *load_trace(const char *path, uint64_t *nr)
+{
+	struct access *trace = NULL;
+	uint64_t n = 0, cap = 0;
+	unsigned long ino, lblk;
+	FILE *fp = fopen(path, "r");
+
+	if (!fp) {
+		perror(path);
+		return NULL;
+	}
+	while (fscanf(fp, "%lu %lu", &ino, &lblk) == 2) {
+		if (n == cap) {
+			cap = cap ? cap * 2 : 65536;
+			trace = realloc(trace, cap * sizeof(*trace));
+			if (!trace)
+				break;
+		}
+		trace[n].ino = ino;
+		trace[n].lblk = lblk;
+		n++;
+	}
+	fclose(fp);
+	*nr = n;
+	return trace;
+}
+
+/*  Zipf ֲķ:  r Ŀʸ 1 / r^s */
+static struct access *zipf_trace(uint64_t nr, uint64_t blocks, double s)
+{
+	struct access *trace = malloc(nr * sizeof(*trace));
+	double *cdf = malloc(blocks * sizeof(*cdf));
+	double sum = 0, u;
+	uint64_t i, lo, hi, mid;
+
+	if (!trace || !cdf) {
+		free(trace);
+		free(cdf);
+		return NULL;
+	}
+	for (i = 0; i < blocks; i++)
+		cdf[i] = sum += 1.0 / pow(i + 1, s);
+
+	for (i = 0; i < nr; i++) {
+		u = (rnd() >> 11) * (1.0 / 9007199254740992.0) * sum;
+		for (lo = 0, hi = blocks - 1; lo < hi; ) {
+			mid = (lo + hi) / 2;
+			if (cdf[mid] < u)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		/* ÿļ 1024  */
+		trace[i].ino = 12 + lo / 1024;
+		trace[i].lblk = lo % 1024;
+	}
+	free(cdf);
+	return trace;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: bench_sketch [options] [trace]\n");
+	fprintf(stderr, "-m: sketch sizes in KB [default:16,64,256,1024,4096]\n");
+	fprintf(stderr, "-z: accesses of the generated zipf trace [default:4000000]\n");
+	fprintf(stderr, "-b: blocks of the generated zipf trace [default:1000000]\n");
+	fprintf(stderr, "-s: skew of the generated zipf trace [default:0.9]\n");
+	fprintf(stderr, "-k: hot set size in blocks [default:1%% of blocks]\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	char sizes[256] = "16,64,256,1024,4096";
+	uint64_t nr = 4000000, blocks = 1000000, hot = 0;
+	double skew = 0.9;
+	struct access *trace;
+	char *p;
+	int c;
+
+	while ((c = getopt(argc, argv, "m:z:b:s:k:")) != -1) {
+		switch (c) {
+		case 'm':
+			snprintf(sizes, sizeof(sizes), "%s", optarg);
+			break;
+		case 'z':
+			nr = strtoull(optarg, NULL, 0);
+			break;
+		case 'b':
+			blocks = strtoull(optarg, NULL, 0);
+			break;
+		case 's':
+			skew = atof(optarg);
+			break;
+		case 'k':
+			hot = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (optind < argc) {
+		trace = load_trace(argv[optind], &nr);
+		blocks = nr;
+	} else {
+		if (!nr || !blocks)
+			usage();
+		trace = zipf_trace(nr, blocks, skew);
+	}
+	if (!trace || !nr) {
+		fprintf(stderr, "no accesses\n");
+		return 1;
+	}
+	if (!hot)
+		hot = blocks / 100 ? blocks / 100 : 1;
+
+	printf("accesses %" PRIu64 ", hot set %" PRIu64 " blocks\n", nr, hot);
+	printf("%8s %10s %8s %8s %8s %8s\n",
+	       "KB", "width", "mae", "exact", "prec", "recall");
+	for (p = strtok(sizes, ","); p; p = strtok(NULL, ","))
+		if (run(trace, nr, atoi(p), hot) < 0)
+			return 1;
+
+	free(trace);
+	return 0;
+}